@@ -0,0 +1,147 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <time.h>
+#include "nanofs.h"
+
+
+/*
+ *  es: Rendimiento de lectura/escritura secuencial según el tamaño de bloque
+ *  en: Sequential read/write throughput depending on the block size
+ */
+
+#define BENCH_FILE_SIZE   (4*1024*1024)    /* Tamaño máximo del fichero / Maximum file size */
+#define BENCH_TOTAL_SIZE  (32*1024*1024)   /* Bytes leídos y escritos / Bytes read and written */
+
+double bench_now ( void )
+{
+   struct timespec t ;
+
+   clock_gettime(CLOCK_MONOTONIC, &t) ;
+   return t.tv_sec + t.tv_nsec / 1e9 ;
+}
+
+int bench_blocksize ( int block_size, char *buffer, double *write_mibs, double *read_mibs )
+{
+   TypeMkfsOptions options ;
+   int    fd, file_size, passes ;
+   double t ;
+
+   // es: dispositivo con sitio para el fichero y los metadatos
+   // en: device with room for the file and the metadata
+   memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+   options.blockSize = block_size ;
+   if (nanofs_mkfs_opts(BENCH_FILE_SIZE / block_size + 128, &options) < 0) {
+       return -1 ;
+   }
+   if (nanofs_mount() < 0) {
+       return -1 ;
+   }
+
+   // es: el fichero más grande posible con este tamaño de bloque (hasta BENCH_FILE_SIZE)
+   // en: the largest possible file with this block size (up to BENCH_FILE_SIZE)
+   file_size = (1 + block_size/4) * block_size ;
+   file_size = (file_size < BENCH_FILE_SIZE) ? file_size : BENCH_FILE_SIZE ;
+   passes    = BENCH_TOTAL_SIZE / file_size ;
+   fd = nanofs_creat("bench.dat") ;
+   if (fd < 0) {
+       nanofs_umount() ;
+       return -1 ;
+   }
+
+   // es: escribir y leer el fichero completo varias veces
+   // en: write and read the whole file several times
+   t = bench_now() ;
+   for (int i=0; i<passes; i++)
+   {
+        nanofs_lseek(fd, 0, SEEK_SET) ;
+        if (nanofs_write(fd, buffer, file_size) != file_size) {
+            nanofs_close(fd) ;
+            nanofs_umount() ;
+            return -1 ;
+        }
+   }
+   *write_mibs = (double)passes * file_size / (1024*1024) / (bench_now() - t) ;
+
+   t = bench_now() ;
+   for (int i=0; i<passes; i++)
+   {
+        nanofs_lseek(fd, 0, SEEK_SET) ;
+        if (nanofs_read(fd, buffer, file_size) != file_size) {
+            nanofs_close(fd) ;
+            nanofs_umount() ;
+            return -1 ;
+        }
+   }
+   *read_mibs = (double)passes * file_size / (1024*1024) / (bench_now() - t) ;
+
+   nanofs_close(fd) ;
+   nanofs_unlink("bench.dat") ;
+   return nanofs_umount() ;
+}
+
+int main ( int argc, char *argv[] )
+{
+   int    sizes[] = { 1024, 4096, 16384, 65536 } ;
+   double write_mibs[4], read_mibs[4] ;
+   char  *devname = DISK ;
+   char  *buffer ;
+   int    ret ;
+
+   // es: dispositivo opcional (p.ej. "direct:disk.dat")
+   // en: optional device (e.g. "direct:disk.dat")
+   if (argc > 1) {
+       devname = argv[1] ;
+   }
+   if (nanofs_setdev(devname) < 0) {
+       return -1 ;
+   }
+
+   buffer = malloc(BENCH_FILE_SIZE) ;
+   if (NULL == buffer) {
+       return -1 ;
+   }
+   for (int i=0; i<BENCH_FILE_SIZE; i++) {
+        buffer[i] = 'a' + (i % 26) ;
+   }
+
+   for (int i=0; i<4; i++)
+   {
+        ret = bench_blocksize(sizes[i], buffer, &(write_mibs[i]), &(read_mibs[i])) ;
+        if (ret < 0) {
+            printf("bench %d bytes -> %d\n", sizes[i], ret) ;
+            free(buffer) ;
+            return -1 ;
+        }
+   }
+
+   // es: resumen (tras la salida de depuración de mount/umount)
+   // en: summary (after the mount/umount debug output)
+   printf("\n") ;
+   printf("Bench: sequential write + read, %d MiB each on %s\n", BENCH_TOTAL_SIZE / (1024*1024), devname) ;
+   for (int i=0; i<4; i++) {
+        printf(" * block size %6d -> write %8.1f MiB/s, read %8.1f MiB/s\n", sizes[i], write_mibs[i], read_mibs[i]) ;
+   }
+
+   free(buffer) ;
+   return 0 ;
+}
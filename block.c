@@ -20,9 +20,994 @@
  */
 
 
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <linux/io_uring.h>
+#undef BLOCK_SIZE      // es: linux/fs.h define el suyo / en: linux/fs.h defines its own
+
 #include "block.h"
 
 
+// es: tamaño de bloque en uso (lo fija el sistema de ficheros al formatear o montar)
+// en: block size in use (set by the file system on mkfs or mount)
+int block_size = BLOCK_SIZE ;
+
+// es: protege la tabla de dispositivos y la reserva de buffers (recursivo: un backend puede usar otros dispositivos)
+// en: protects the device table and the buffer pool (recursive: a backend may use other devices)
+pthread_mutex_t block_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP ;
+
+
+/*
+ *  es: Dispositivos y backends
+ *  en: Devices and backends
+ *
+ *  es: El nombre del dispositivo es "[backend:]path". Cada dispositivo se abre
+ *      la primera vez que se usa y sigue abierto hasta bclose().
+ *  en: The device name is "[backend:]path". Each device is opened the first
+ *      time it is used and stays open until bclose().
+ */
+
+struct block_ops ;
+
+typedef struct {
+    char  name[DEVICE_NAME_LENGTH+1] ;  // es: nombre completo ("" si el hueco está libre)
+                                        // en: full name ("" if the slot is free)
+    struct block_ops *ops ;
+    int   fd ;           // es: descriptor principal (con O_DIRECT si se pudo)
+                         // en: main descriptor (with O_DIRECT if possible)
+    int   fd_buffered ;  // es: descriptor sin O_DIRECT para accesos no alineados (-1: fd no usa O_DIRECT)
+                         // en: descriptor without O_DIRECT for unaligned accesses (-1: fd does not use O_DIRECT)
+    void *priv ;         // es: estado propio del backend (NULL si no tiene)
+                         // en: backend own state (NULL if none)
+} TypeBlockDevice ;
+
+typedef struct block_ops {
+    char *prefix ;
+    int   fd_io ;    // es: 1: pread/pwrite sobre dev->fd (se puede usar con io_uring)
+                     // en: 1: pread/pwrite on dev->fd (can be used with io_uring)
+    int (*open)  ( TypeBlockDevice *dev, char *path ) ;
+    int (*read)  ( TypeBlockDevice *dev, int bid, int n, void *buffer ) ;  // es: n bloques consecutivos
+    int (*write) ( TypeBlockDevice *dev, int bid, int n, void *buffer ) ;  // en: n consecutive blocks
+    int (*close) ( TypeBlockDevice *dev ) ;
+} TypeBlockOps ;
+
+TypeBlockDevice block_devices [BLOCK_DEVICES] ;
+
+TypeBlockDevice *bdev_get ( char *devname ) ;  // es: también lo usan los backends compuestos (stripe)
+                                               // en: also used by composite backends (stripe)
+
+
+/*
+ *  es: Reserva de buffers alineados
+ *  en: Aligned buffer pool
+ *
+ *  es: Buffers alineados a página que se reutilizan en lugar de reservarse en
+ *      pila o con malloc en cada operación. Si la reserva está agotada se
+ *      devuelve un buffer alineado fuera de ella, que bpool_put() libera.
+ *  en: Page-aligned buffers that are reused instead of being placed on the
+ *      stack or malloc'ed on every operation. If the pool is exhausted, an
+ *      aligned buffer outside of it is returned, and bpool_put() frees it.
+ */
+
+struct {
+    void  *buffer ;
+    size_t size ;
+    int    in_use ;
+} bpool [BPOOL_BUFFERS] ;
+
+void *bpool_get ( size_t size )
+{
+   void *buffer ;
+   int   slot = -1 ;
+
+   // es: tamaño múltiplo del alineamiento
+   // en: size multiple of the alignment
+   size = (size + BLOCK_ALIGN - 1) & ~((size_t)BLOCK_ALIGN - 1) ;
+
+   // es: reutilizar un buffer libre suficientemente grande (si no, el hueco libre más grande)
+   // en: reuse a free buffer that is big enough (otherwise, the biggest free slot)
+   pthread_mutex_lock(&block_lock) ;
+   for (int i=0; i<BPOOL_BUFFERS; i++)
+   {
+        if (bpool[i].in_use) {
+            continue ;
+        }
+        if (bpool[i].size >= size) {
+            bpool[i].in_use = 1 ;
+            pthread_mutex_unlock(&block_lock) ;
+            return bpool[i].buffer ;
+        }
+        if ( (-1 == slot) || (bpool[i].size > bpool[slot].size) ) {
+            slot = i ;
+        }
+   }
+
+   if (0 != posix_memalign(&buffer, BLOCK_ALIGN, size)) {
+       pthread_mutex_unlock(&block_lock) ;
+       return NULL ;
+   }
+
+   // es: sustituir el buffer del hueco libre (si lo hay)
+   // en: replace the buffer of the free slot (if any)
+   if (-1 != slot)
+   {
+       free(bpool[slot].buffer) ;
+       bpool[slot].buffer = buffer ;
+       bpool[slot].size   = size ;
+       bpool[slot].in_use = 1 ;
+   }
+   pthread_mutex_unlock(&block_lock) ;
+
+   return buffer ;
+}
+
+void bpool_put ( void *buffer )
+{
+   if (NULL == buffer) {
+       return ;
+   }
+
+   // es: devolver el buffer a la reserva
+   // en: give the buffer back to the pool
+   pthread_mutex_lock(&block_lock) ;
+   for (int i=0; i<BPOOL_BUFFERS; i++)
+   {
+        if (bpool[i].buffer == buffer) {
+            bpool[i].in_use = 0 ;
+            pthread_mutex_unlock(&block_lock) ;
+            return ;
+        }
+   }
+   pthread_mutex_unlock(&block_lock) ;
+
+   // es: buffer reservado con la reserva agotada
+   // en: buffer allocated while the pool was exhausted
+   free(buffer) ;
+}
+
+
+/*
+ *  es: Backend de fichero (pread/pwrite, opcionalmente con O_DIRECT)
+ *  en: File backend (pread/pwrite, optionally with O_DIRECT)
+ */
+
+int bdev_pio ( int fd, int is_write, void *buffer, size_t size, off_t offset )
+{
+   ssize_t ret ;
+   size_t  done = 0 ;
+
+   while (done < size)
+   {
+        if (is_write) {
+            ret = pwrite(fd, (char *)buffer + done, size - done, offset + done) ;
+        } else {
+            ret = pread (fd, (char *)buffer + done, size - done, offset + done) ;
+        }
+        if (ret < 0) {
+            return -1 ;
+        }
+
+        // es: leer más allá del final del fichero devuelve ceros
+        // en: reading beyond the end of file returns zeros
+        if (0 == ret) {
+            if (is_write) {
+                return -1 ;
+            }
+            memset((char *)buffer + done, 0, size - done) ;
+            break ;
+        }
+        done += ret ;
+   }
+
+   return 1 ;
+}
+
+int bdev_file_io ( TypeBlockDevice *dev, int is_write, int bid, int n, void *buffer )
+{
+   void  *aligned ;
+   off_t  offset = (off_t)bid * block_size ;
+   size_t size   = (size_t)n * block_size ;
+   int    ret ;
+
+   // es: sin O_DIRECT el buffer puede ser cualquiera
+   // en: without O_DIRECT any buffer is fine
+   if (-1 == dev->fd_buffered) {
+       return bdev_pio(dev->fd, is_write, buffer, size, offset) ;
+   }
+
+   // es: con O_DIRECT, usar un buffer alineado de la reserva si el del llamante no lo está
+   // en: with O_DIRECT, use an aligned buffer from the pool if the caller's one is not aligned
+   aligned = buffer ;
+   if (0 != ((uintptr_t)buffer % BLOCK_ALIGN))
+   {
+       aligned = bpool_get(size) ;
+       if (NULL == aligned) {
+           return -1 ;
+       }
+       if (is_write) {
+           memmove(aligned, buffer, size) ;
+       }
+   }
+
+   // es: si el dispositivo rechaza el acceso directo (EINVAL) se repite con buffer
+   // en: if the device rejects the direct access (EINVAL), retry it buffered
+   ret = bdev_pio(dev->fd, is_write, aligned, size, offset) ;
+   if ( (ret < 0) && (EINVAL == errno) ) {
+       ret = bdev_pio(dev->fd_buffered, is_write, aligned, size, offset) ;
+   }
+
+   if (aligned != buffer)
+   {
+       if ( (ret >= 0) && (! is_write) ) {
+           memmove(buffer, aligned, size) ;
+       }
+       bpool_put(aligned) ;
+   }
+
+   return ret ;
+}
+
+int bdev_file_open ( TypeBlockDevice *dev, char *path )
+{
+   dev->fd          = open(path, O_RDWR) ;
+   dev->fd_buffered = -1 ;
+
+   return (dev->fd < 0) ? -1 : 1 ;
+}
+
+int bdev_direct_open ( TypeBlockDevice *dev, char *path )
+{
+   // es: sin soporte de O_DIRECT (p.ej. tmpfs) se usa el backend de fichero
+   // en: without O_DIRECT support (e.g. tmpfs) the file backend is used
+   dev->fd = open(path, O_RDWR | O_DIRECT) ;
+   if (dev->fd < 0) {
+       return bdev_file_open(dev, path) ;
+   }
+
+   dev->fd_buffered = open(path, O_RDWR) ;
+   if (dev->fd_buffered < 0) {
+       close(dev->fd) ;
+       return -1 ;
+   }
+
+   return 1 ;
+}
+
+int bdev_file_read ( TypeBlockDevice *dev, int bid, int n, void *buffer )
+{
+   return bdev_file_io(dev, 0, bid, n, buffer) ;
+}
+
+int bdev_file_write ( TypeBlockDevice *dev, int bid, int n, void *buffer )
+{
+   return bdev_file_io(dev, 1, bid, n, buffer) ;
+}
+
+int bdev_file_close ( TypeBlockDevice *dev )
+{
+   close(dev->fd) ;
+   if (-1 != dev->fd_buffered) {
+       close(dev->fd_buffered) ;
+   }
+
+   return 1 ;
+}
+
+
+
+/*
+ *  es: Backend de red: cliente de blockd ("unix:path" o "tcp:host:puerto")
+ *  en: Network backend: blockd client ("unix:path" or "tcp:host:port")
+ *
+ *  es: Varios hilos pueden tener peticiones en curso a la vez en la misma
+ *      conexión: cada petición se envía entera con el cerrojo cogido y su id
+ *      es consecutivo; blockd responde en orden, así que cada hilo espera su
+ *      turno y lee su propia respuesta sin bloquear los envíos de los demás.
+ *  en: Several threads may have requests in flight at the same time on the
+ *      same connection: each request is sent whole with the lock held and
+ *      its id is consecutive; blockd replies in order, so each thread waits
+ *      for its turn and reads its own reply without blocking the others' sends.
+ */
+
+typedef struct {
+    pthread_mutex_t lock ;
+    pthread_cond_t  turn ;
+    uint32_t next_id ;      // es: id de la siguiente petición
+                            // en: id of the next request
+    uint32_t next_reply ;   // es: id de la siguiente respuesta a leer
+                            // en: id of the next reply to be read
+    int      broken ;       // es: 1: conexión inservible
+                            // en: 1: unusable connection
+} TypeNetState ;
+
+int bdev_sock_io ( int fd, int is_send, void *buffer, size_t size, int flags )
+{
+   ssize_t ret ;
+   size_t  done = 0 ;
+
+   while (done < size)
+   {
+        if (is_send) {
+            ret = send(fd, (char *)buffer + done, size - done, MSG_NOSIGNAL | flags) ;
+        } else {
+            ret = recv(fd, (char *)buffer + done, size - done, 0) ;
+        }
+        if ( (ret < 0) && (EINTR == errno) ) {
+            continue ;
+        }
+        if (ret <= 0) {
+            return -1 ;
+        }
+        done += ret ;
+   }
+
+   return 1 ;
+}
+
+int bdev_sock_connect ( char *address, int is_server )
+{
+   struct sockaddr_un sun ;
+   struct addrinfo hints, *res, *ai ;
+   char   host[DEVICE_NAME_LENGTH+1], *port ;
+   int    fd = -1, one = 1 ;
+
+   // es: "unix:path"
+   // en: "unix:path"
+   if (! strncmp(address, "unix:", 5))
+   {
+       if (strlen(address + 5) >= sizeof(sun.sun_path)) {
+           return -1 ;
+       }
+       memset(&sun, 0, sizeof(sun)) ;
+       sun.sun_family = AF_UNIX ;
+       strcpy(sun.sun_path, address + 5) ;
+
+       fd = socket(AF_UNIX, SOCK_STREAM, 0) ;
+       if (fd < 0) {
+           return -1 ;
+       }
+       if (is_server) {
+           unlink(sun.sun_path) ;
+       }
+       if ( ( is_server) && ( (bind(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) || (listen(fd, 16) < 0) ) ) {
+           close(fd) ;
+           return -1 ;
+       }
+       if ( (! is_server) && (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) ) {
+           close(fd) ;
+           return -1 ;
+       }
+       return fd ;
+   }
+
+   // es: "tcp:[host:]puerto" (sin host: cualquiera al servir, localhost al conectar)
+   // en: "tcp:[host:]port" (without host: any when serving, localhost when connecting)
+   if ( (strncmp(address, "tcp:", 4)) || (strlen(address + 4) > DEVICE_NAME_LENGTH) ) {
+       return -1 ;
+   }
+   strcpy(host, address + 4) ;
+   port = strrchr(host, ':') ;
+   if (NULL != port) {
+       *port = '\0' ;
+       port++ ;
+   }
+   else {
+       port = host ;
+   }
+
+   memset(&hints, 0, sizeof(hints)) ;
+   hints.ai_family   = AF_UNSPEC ;
+   hints.ai_socktype = SOCK_STREAM ;
+   hints.ai_flags    = is_server ? AI_PASSIVE : 0 ;
+   if (0 != getaddrinfo((port == host) ? NULL : host, port, &hints, &res)) {
+       return -1 ;
+   }
+   for (ai = res; NULL != ai; ai = ai->ai_next)
+   {
+        fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol) ;
+        if (fd < 0) {
+            continue ;
+        }
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)) ;
+        if (is_server) {
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) ;
+            if ( (bind(fd, ai->ai_addr, ai->ai_addrlen) >= 0) && (listen(fd, 16) >= 0) ) {
+                break ;
+            }
+        }
+        else if (connect(fd, ai->ai_addr, ai->ai_addrlen) >= 0) {
+            break ;
+        }
+        close(fd) ;
+        fd = -1 ;
+   }
+   freeaddrinfo(res) ;
+
+   return fd ;
+}
+
+int bdev_net_open ( TypeBlockDevice *dev, char *path )
+{
+   TypeNetState *st ;
+
+   // es: el prefijo forma parte de la dirección
+   // en: the prefix is part of the address
+   dev->fd          = bdev_sock_connect(path - strlen(dev->ops->prefix), 0) ;
+   dev->fd_buffered = -1 ;
+   if (dev->fd < 0) {
+       return -1 ;
+   }
+
+   st = malloc(sizeof(TypeNetState)) ;
+   if (NULL == st) {
+       close(dev->fd) ;
+       return -1 ;
+   }
+   pthread_mutex_init(&(st->lock), NULL) ;
+   pthread_cond_init(&(st->turn), NULL) ;
+   st->next_id    = 0 ;
+   st->next_reply = 0 ;
+   st->broken     = 0 ;
+   dev->priv = st ;
+
+   return 1 ;
+}
+
+int bdev_net_req ( TypeBlockDevice *dev, int is_write, int bid, int n, void *buffer )
+{
+   TypeNetState     *st = dev->priv ;
+   TypeBlockdRequest req ;
+   TypeBlockdReply   rep ;
+   size_t   size = (size_t)n * block_size ;
+   uint32_t id ;
+   int      ret ;
+
+   if (size > BLOCKD_MAX_IO) {
+       return -1 ;
+   }
+
+   // es: enviar la petición entera (cabecera + datos a escribir)
+   // en: send the whole request (header + data to be written)
+   req.magic     = htonl(BLOCKD_MAGIC) ;
+   req.op        = htonl(is_write ? BLOCKD_WRITE : BLOCKD_READ) ;
+   req.blockSize = htonl(block_size) ;
+   req.bid       = htonl(bid) ;
+   req.count     = htonl(n) ;
+
+   pthread_mutex_lock(&(st->lock)) ;
+   id     = st->next_id++ ;
+   req.id = htonl(id) ;
+   if ( (! st->broken) &&
+        ( (bdev_sock_io(dev->fd, 1, &req, sizeof(req), is_write ? MSG_MORE : 0) < 0) ||
+          ( (is_write) && (bdev_sock_io(dev->fd, 1, buffer, size, 0) < 0) ) ) ) {
+       st->broken = 1 ;
+   }
+
+   // es: esperar el turno de nuestra respuesta (sin el cerrojo mientras se lee)
+   // en: wait for the turn of our reply (without the lock while reading)
+   while ( (st->next_reply != id) && (! st->broken) ) {
+       pthread_cond_wait(&(st->turn), &(st->lock)) ;
+   }
+   ret = st->broken ? -1 : 1 ;
+   pthread_mutex_unlock(&(st->lock)) ;
+
+   if ( (ret >= 0) && (bdev_sock_io(dev->fd, 0, &rep, sizeof(rep), 0) < 0) ) {
+       ret = -2 ;
+   }
+   if ( (ret >= 0) && ( (ntohl(rep.magic) != BLOCKD_MAGIC) || (ntohl(rep.id) != id) ) ) {
+       ret = -2 ;
+   }
+   if ( (ret >= 0) && ((int32_t)ntohl(rep.result) < 0) ) {
+       ret = -1 ;
+   }
+   else if ( (ret >= 0) && (! is_write) && (bdev_sock_io(dev->fd, 0, buffer, size, 0) < 0) ) {
+       ret = -2 ;
+   }
+
+   // es: ceder el turno (-2: el flujo queda desincronizado)
+   // en: pass the turn (-2: the stream is out of sync)
+   pthread_mutex_lock(&(st->lock)) ;
+   if (-2 == ret) {
+       st->broken = 1 ;
+       ret = -1 ;
+   }
+   st->next_reply++ ;
+   pthread_cond_broadcast(&(st->turn)) ;
+   pthread_mutex_unlock(&(st->lock)) ;
+
+   return ret ;
+}
+
+int bdev_net_io ( TypeBlockDevice *dev, int is_write, int bid, int n, void *buffer )
+{
+   int max = BLOCKD_MAX_IO / block_size ;
+   int ret = 1 ;
+
+   // es: peticiones de hasta BLOCKD_MAX_IO bytes
+   // en: requests of up to BLOCKD_MAX_IO bytes
+   for (int i=0; (i<n) && (ret >= 0); i+=max) {
+        ret = bdev_net_req(dev, is_write, bid + i, (n - i < max) ? n - i : max, (char *)buffer + (size_t)i * block_size) ;
+   }
+
+   return ret ;
+}
+
+int bdev_net_read ( TypeBlockDevice *dev, int bid, int n, void *buffer )
+{
+   return bdev_net_io(dev, 0, bid, n, buffer) ;
+}
+
+int bdev_net_write ( TypeBlockDevice *dev, int bid, int n, void *buffer )
+{
+   return bdev_net_io(dev, 1, bid, n, buffer) ;
+}
+
+int bdev_net_close ( TypeBlockDevice *dev )
+{
+   TypeNetState *st = dev->priv ;
+
+   close(dev->fd) ;
+   pthread_cond_destroy(&(st->turn)) ;
+   pthread_mutex_destroy(&(st->lock)) ;
+   free(st) ;
+   dev->priv = NULL ;
+
+   return 1 ;
+}
+
+/*
+ *  es: Backend stripe (RAID-0): "stripe:<unidad>[+<cabecera>]:<disp.>,<disp.>,..."
+ *  en: Stripe backend (RAID-0): "stripe:<unit>[+<head>]:<dev>,<dev>,..."
+ *
+ *  es: Los bytes del dispositivo se reparten por unidades (KiB, múltiplo de
+ *      BLOCK_SIZE_MAX para que ningún bloque quede partido) entre los
+ *      miembros, que pueden ser cualquier otro dispositivo. La cabecera
+ *      opcional (KiB, mismo múltiplo) va entera al primer miembro, para que
+ *      los metadatos del sistema de ficheros (al principio) estén juntos.
+ *      Cada miembro tiene un hilo, así que una petición de varios bloques se
+ *      reparte y se hace en todos los miembros a la vez.
+ *  en: The device bytes are spread in units (KiB, multiple of BLOCK_SIZE_MAX
+ *      so that no block is split) among the members, which may be any other
+ *      device. The optional head (KiB, same multiple) goes whole to the first
+ *      member, so that the file system metadata (at the beginning) stays
+ *      together. Each member has a thread, so a multi-block request is split
+ *      and done on all members at the same time.
+ */
+
+typedef struct stripe_job {
+    pthread_mutex_t lock ;
+    pthread_cond_t  cond ;
+    int   pending ;       // es: segmentos sin terminar
+                          // en: segments not finished yet
+    int   result ;
+} TypeStripeJob ;
+
+typedef struct stripe_seg {
+    int    bid ;          // es: bloque en el miembro
+                          // en: block in the member
+    int    n ;
+    char  *buffer ;
+    int    is_write ;
+    TypeStripeJob     *job ;
+    struct stripe_seg *next ;
+} TypeStripeSeg ;
+
+typedef struct {
+    struct stripe_state *st ;
+    int    member ;
+} TypeStripeWorker ;
+
+typedef struct stripe_state {
+    int    num_members ;
+    char   members[STRIPE_MEMBERS][DEVICE_NAME_LENGTH+1] ;
+    off_t  unit ;
+    off_t  head ;
+    pthread_mutex_t lock ;
+    pthread_cond_t  cond ;
+    TypeStripeSeg  *queue[STRIPE_MEMBERS] ;  // es: segmentos pendientes por miembro
+                                             // en: pending segments per member
+    pthread_t threads[STRIPE_MEMBERS] ;
+    TypeStripeWorker workers[STRIPE_MEMBERS] ;  // es: argumento de cada hilo
+                                                // en: argument of each thread
+    int    stop ;
+} TypeStripeState ;
+
+int bdev_stripe_map ( TypeStripeState *st, off_t offset, off_t *member_offset, off_t *length )
+{
+   off_t unit_id ;
+   int   member ;
+
+   // es: la cabecera está en el primer miembro
+   // en: the head is in the first member
+   if (offset < st->head) {
+       *member_offset = offset ;
+       *length        = st->head - offset ;
+       return 0 ;
+   }
+
+   // es: resto por unidades en turno rotatorio (el primer miembro, tras la cabecera)
+   // en: the rest in units round-robin (the first member, after the head)
+   offset  = offset - st->head ;
+   unit_id = offset / st->unit ;
+   member  = unit_id % st->num_members ;
+   *member_offset = (unit_id / st->num_members) * st->unit + offset % st->unit + ((0 == member) ? st->head : 0) ;
+   *length        = st->unit - offset % st->unit ;
+
+   return member ;
+}
+
+int bdev_stripe_seg_io ( TypeStripeState *st, int member, TypeStripeSeg *seg )
+{
+   if (seg->is_write) {
+       return bwriten(st->members[member], seg->bid, seg->n, seg->buffer) ;
+   }
+   return breadn(st->members[member], seg->bid, seg->n, seg->buffer) ;
+}
+
+void *bdev_stripe_worker ( void *arg )
+{
+   TypeStripeWorker *w  = arg ;
+   TypeStripeState  *st = w->st ;
+   int member = w->member ;
+   TypeStripeSeg *seg ;
+   int ret ;
+
+   for (;;)
+   {
+        // es: esperar un segmento para este miembro
+        // en: wait for a segment for this member
+        pthread_mutex_lock(&(st->lock)) ;
+        while ( (NULL == st->queue[member]) && (! st->stop) ) {
+            pthread_cond_wait(&(st->cond), &(st->lock)) ;
+        }
+        seg = st->queue[member] ;
+        if (NULL == seg) {
+            pthread_mutex_unlock(&(st->lock)) ;
+            return NULL ;
+        }
+        st->queue[member] = seg->next ;
+        pthread_mutex_unlock(&(st->lock)) ;
+
+        // es: hacerlo y avisar si era el último de la petición
+        // en: do it and notify if it was the last one of the request
+        ret = bdev_stripe_seg_io(st, member, seg) ;
+        pthread_mutex_lock(&(seg->job->lock)) ;
+        if (ret < 0) {
+            seg->job->result = -1 ;
+        }
+        seg->job->pending-- ;
+        if (0 == seg->job->pending) {
+            pthread_cond_signal(&(seg->job->cond)) ;
+        }
+        pthread_mutex_unlock(&(seg->job->lock)) ;
+   }
+}
+
+void bdev_stripe_stop ( TypeStripeState *st, int num_threads )
+{
+   // es: parar los num_threads primeros hilos y cerrar todos los miembros
+   // en: stop the first num_threads threads and close all the members
+   pthread_mutex_lock(&(st->lock)) ;
+   st->stop = 1 ;
+   pthread_cond_broadcast(&(st->cond)) ;
+   pthread_mutex_unlock(&(st->lock)) ;
+   for (int i=0; i<num_threads; i++) {
+        pthread_join(st->threads[i], NULL) ;
+   }
+   for (int i=0; i<st->num_members; i++) {
+        bclose(st->members[i]) ;
+   }
+
+   pthread_cond_destroy(&(st->cond)) ;
+   pthread_mutex_destroy(&(st->lock)) ;
+   free(st) ;
+}
+
+int bdev_stripe_open ( TypeBlockDevice *dev, char *path )
+{
+   TypeStripeState *st ;
+   char *end, *name ;
+   long  unit, head = 0 ;
+
+   // es: "<unidad>[+<cabecera>]:" en KiB
+   // en: "<unit>[+<head>]:" in KiB
+   unit = strtol(path, &end, 10) ;
+   if ('+' == *end) {
+       head = strtol(end + 1, &end, 10) ;
+   }
+   if ( (':' != *end) || (unit <= 0) || (head < 0) ||
+        (0 != (unit * 1024) % BLOCK_SIZE_MAX) || (0 != (head * 1024) % BLOCK_SIZE_MAX) ) {
+       return -1 ;
+   }
+
+   st = malloc(sizeof(TypeStripeState)) ;
+   if (NULL == st) {
+       return -1 ;
+   }
+   memset(st, 0, sizeof(TypeStripeState)) ;
+   st->unit = (off_t)unit * 1024 ;
+   st->head = (off_t)head * 1024 ;
+
+   // es: miembros separados por comas (se abren ya)
+   // en: comma separated members (they are opened now)
+   name = end + 1 ;
+   while ( ('\0' != *name) && (st->num_members < STRIPE_MEMBERS) )
+   {
+        end = strchr(name, ',') ;
+        if (NULL == end) {
+            end = name + strlen(name) ;
+        }
+        if ( (end == name) || (end - name > DEVICE_NAME_LENGTH) ) {
+            break ;
+        }
+        memmove(st->members[st->num_members], name, end - name) ;
+        st->members[st->num_members][end - name] = '\0' ;
+        if (NULL == bdev_get(st->members[st->num_members])) {
+            break ;
+        }
+        st->num_members++ ;
+        name = ('\0' == *end) ? end : end + 1 ;
+   }
+   if ( ('\0' != *name) || (0 == st->num_members) )
+   {
+       for (int i=0; i<st->num_members; i++) {
+            bclose(st->members[i]) ;
+       }
+       free(st) ;
+       return -1 ;
+   }
+
+   // es: un hilo por miembro
+   // en: one thread per member
+   pthread_mutex_init(&(st->lock), NULL) ;
+   pthread_cond_init(&(st->cond), NULL) ;
+   for (int i=0; i<st->num_members; i++)
+   {
+        st->workers[i].st     = st ;
+        st->workers[i].member = i ;
+        if (0 != pthread_create(&(st->threads[i]), NULL, bdev_stripe_worker, &(st->workers[i])))
+        {
+            // es: sin su hilo las peticiones a ese miembro no terminarían nunca
+            // en: without its thread the requests to that member would never complete
+            bdev_stripe_stop(st, i) ;
+            return -1 ;
+        }
+   }
+
+   dev->fd          = -1 ;
+   dev->fd_buffered = -1 ;
+   dev->priv        = st ;
+
+   return 1 ;
+}
+
+int bdev_stripe_io ( TypeBlockDevice *dev, int is_write, int bid, int n, void *buffer )
+{
+   TypeStripeState *st = dev->priv ;
+   TypeStripeSeg    one, *segs, *seg ;
+   TypeStripeJob    job ;
+   off_t  offset, end, member_offset, length ;
+   int    member, num_segs, ret ;
+
+   offset = (off_t)bid * block_size ;
+   end    = offset + (off_t)n * block_size ;
+
+   // es: dentro de una sola unidad -> directamente en este hilo
+   // en: within a single unit -> directly in this thread
+   member = bdev_stripe_map(st, offset, &member_offset, &length) ;
+   if (end - offset <= length)
+   {
+       one.bid      = member_offset / block_size ;
+       one.n        = n ;
+       one.buffer   = buffer ;
+       one.is_write = is_write ;
+       return bdev_stripe_seg_io(st, member, &one) ;
+   }
+
+   // es: un segmento por unidad, repartidos en las colas de los miembros
+   // en: one segment per unit, spread over the member queues
+   num_segs = (end - offset + st->unit - 1) / st->unit + 2 ;
+   segs = malloc(num_segs * sizeof(TypeStripeSeg)) ;
+   if (NULL == segs) {
+       return -1 ;
+   }
+   pthread_mutex_init(&(job.lock), NULL) ;
+   pthread_cond_init(&(job.cond), NULL) ;
+   job.pending = 0 ;
+   job.result  = 1 ;
+
+   pthread_mutex_lock(&(job.lock)) ;
+   pthread_mutex_lock(&(st->lock)) ;
+   for (int i=0; offset < end; i++)
+   {
+        member = bdev_stripe_map(st, offset, &member_offset, &length) ;
+        length = (length < end - offset) ? length : end - offset ;
+
+        seg = &(segs[i]) ;
+        seg->bid      = member_offset / block_size ;
+        seg->n        = length / block_size ;
+        seg->buffer   = (char *)buffer + (offset - (off_t)bid * block_size) ;
+        seg->is_write = is_write ;
+        seg->job      = &job ;
+        seg->next     = NULL ;
+
+        // es: al final de la cola del miembro (en orden)
+        // en: at the end of the member queue (in order)
+        TypeStripeSeg **last = &(st->queue[member]) ;
+        while (NULL != *last) {
+            last = &((*last)->next) ;
+        }
+        *last = seg ;
+
+        job.pending++ ;
+        offset += length ;
+   }
+   pthread_cond_broadcast(&(st->cond)) ;
+   pthread_mutex_unlock(&(st->lock)) ;
+
+   // es: esperar a todos los segmentos
+   // en: wait for all the segments
+   while (job.pending > 0) {
+       pthread_cond_wait(&(job.cond), &(job.lock)) ;
+   }
+   ret = job.result ;
+   pthread_mutex_unlock(&(job.lock)) ;
+
+   pthread_cond_destroy(&(job.cond)) ;
+   pthread_mutex_destroy(&(job.lock)) ;
+   free(segs) ;
+
+   return ret ;
+}
+
+int bdev_stripe_read ( TypeBlockDevice *dev, int bid, int n, void *buffer )
+{
+   return bdev_stripe_io(dev, 0, bid, n, buffer) ;
+}
+
+int bdev_stripe_write ( TypeBlockDevice *dev, int bid, int n, void *buffer )
+{
+   return bdev_stripe_io(dev, 1, bid, n, buffer) ;
+}
+
+int bdev_stripe_close ( TypeBlockDevice *dev )
+{
+   bdev_stripe_stop(dev->priv, ((TypeStripeState *)dev->priv)->num_members) ;
+   dev->priv = NULL ;
+
+   return 1 ;
+}
+
+// es: backends por prefijo (el último, sin prefijo, es el de por defecto)
+// en: backends by prefix (the last one, without prefix, is the default one)
+TypeBlockOps block_backends[] = {
+   { "direct:", 1, bdev_direct_open, bdev_file_read, bdev_file_write, bdev_file_close },
+   { "unix:",   0, bdev_net_open,    bdev_net_read,  bdev_net_write,  bdev_net_close  },
+   { "tcp:",    0, bdev_net_open,    bdev_net_read,  bdev_net_write,  bdev_net_close  },
+   { "stripe:", 0, bdev_stripe_open, bdev_stripe_read, bdev_stripe_write, bdev_stripe_close },
+   { "",        1, bdev_file_open,   bdev_file_read, bdev_file_write, bdev_file_close },
+} ;
+
+
+/*
+ *  es: Tabla de dispositivos abiertos
+ *  en: Open devices table
+ */
+
+TypeBlockDevice *bdev_lookup ( char *devname )
+{
+   TypeBlockOps *ops ;
+   int free_slot = -1 ;
+
+   // es: un nombre vacío coincidiría con un hueco libre
+   // en: an empty name would match a free slot
+   if ('\0' == devname[0]) {
+       return NULL ;
+   }
+
+   // es: buscar el dispositivo ya abierto
+   // en: search for the device already open
+   for (int i=0; i<BLOCK_DEVICES; i++)
+   {
+        if (! strcmp(block_devices[i].name, devname)) {
+            return &(block_devices[i]) ;
+        }
+        if ( (-1 == free_slot) && ('\0' == block_devices[i].name[0]) ) {
+            free_slot = i ;
+        }
+   }
+   if ( (-1 == free_slot) || (strlen(devname) > DEVICE_NAME_LENGTH) ) {
+       return NULL ;
+   }
+
+   // es: elegir el backend por el prefijo y abrir
+   // en: choose the backend by prefix and open
+   ops = block_backends ;
+   while (strncmp(devname, ops->prefix, strlen(ops->prefix))) {
+       ops++ ;
+   }
+   // es: el nombre se pone antes de abrir para reservar el hueco (los
+   //     backends compuestos abren otros dispositivos dentro de open)
+   // en: the name is set before opening to reserve the slot (composite
+   //     backends open other devices inside open)
+   block_devices[free_slot].ops  = ops ;
+   block_devices[free_slot].priv = NULL ;
+   strcpy(block_devices[free_slot].name, devname) ;
+   if (ops->open(&(block_devices[free_slot]), devname + strlen(ops->prefix)) < 0) {
+       block_devices[free_slot].name[0] = '\0' ;
+       return NULL ;
+   }
+
+   return &(block_devices[free_slot]) ;
+}
+
+TypeBlockDevice *bdev_get ( char *devname )
+{
+   TypeBlockDevice *dev ;
+
+   pthread_mutex_lock(&block_lock) ;
+   dev = bdev_lookup(devname) ;
+   pthread_mutex_unlock(&block_lock) ;
+
+   return dev ;
+}
+
+int bclose ( char *devname )
+{
+   // es: cerrar el dispositivo (si está abierto)
+   // en: close the device (if open)
+   pthread_mutex_lock(&block_lock) ;
+   for (int i=0; i<BLOCK_DEVICES; i++)
+   {
+        if (! strcmp(block_devices[i].name, devname))
+        {
+            block_devices[i].ops->close(&(block_devices[i])) ;
+            block_devices[i].name[0] = '\0' ;
+            pthread_mutex_unlock(&block_lock) ;
+            return 1 ;
+        }
+   }
+   pthread_mutex_unlock(&block_lock) ;
+
+   return -1 ;
+}
+
+
+/*
+ *  es: Tamaño de bloque
+ *  en: Block size
+ */
+
+int bsetsize ( int size )
+{
+   // es: potencia de 2 entre BLOCK_SIZE_MIN y BLOCK_SIZE_MAX
+   // en: power of 2 between BLOCK_SIZE_MIN and BLOCK_SIZE_MAX
+   if ( (size < BLOCK_SIZE_MIN) || (size > BLOCK_SIZE_MAX) || (0 != (size & (size - 1))) ) {
+       return -1 ;
+   }
+
+   block_size = size ;
+   return 1 ;
+}
+
+int bgetsize ( void )
+{
+   return block_size ;
+}
+
+
 /*
  *  es: Interfaz servidor de bloques (block-read + block-write)
  *  en: Block Disk Interface
@@ -30,51 +1015,600 @@
 
 int bread ( char *devname, int bid, void *buffer )
 {
-   FILE *fd1 ;
-   int ret ;
+   TypeBlockDevice *dev ;
 
-   // 1) es: abre el dispositivo de disco "devname"
-   // 1) en: open "devname" disk
-      fd1 = fopen(devname, "r") ;
-      if (NULL == fd1) {
+   // 1) es: obtiene el dispositivo de disco "devname" (lo abre la primera vez)
+   // 1) en: get the "devname" disk (open it the first time)
+      dev = bdev_get(devname) ;
+      if (NULL == dev) {
           return -1 ;
       }
 
-   // 2) es: salta al bloque bid y lo lee. Identificador de bloque empieza en cero.
-   // 2) en: seek to the bid-th block and read it. Read operation starts at 0
-      ret = fseek(fd1, bid*BLOCK_SIZE, SEEK_SET) ;
-      if (0 == ret) { 
-          ret = fread(buffer, BLOCK_SIZE, 1, fd1) ;
-          fclose(fd1) ;
-      }
-
-   // 3) es: devuelve ok
-   // 3) en: return ok
-      return ret ;
+   // 2) es: lee el bloque bid. Identificador de bloque empieza en cero.
+   // 2) en: read the bid-th block. Read operation starts at 0
+      return dev->ops->read(dev, bid, 1, buffer) ;
 }
 
 int bwrite ( char *devname, int bid, void *buffer )
 {
-   FILE *fd1 ;
-   int ret ;
+   TypeBlockDevice *dev ;
 
-   // 1) es: abre el dispositivo de disco "devname"
-   // 1) en: open "devname" disk
-      fd1 = fopen(devname, "r+") ;
-      if (NULL == fd1) {
+   // 1) es: obtiene el dispositivo de disco "devname" (lo abre la primera vez)
+   // 1) en: get the "devname" disk (open it the first time)
+      dev = bdev_get(devname) ;
+      if (NULL == dev) {
           return -1 ;
       }
 
-   // 2) es: salta al bloque bid y lo escribe. Identificador de bloque empieza en cero.
-   // 2) en: seek to the bid-th block and write it. Write operation starts at 0
-      ret = fseek(fd1, bid*BLOCK_SIZE, SEEK_SET) ;
-      if (0 == ret) { 
-          ret = fwrite(buffer, BLOCK_SIZE, 1, fd1) ;
-          fclose(fd1) ;
-      }
+   // 2) es: escribe el bloque bid. Identificador de bloque empieza en cero.
+   // 2) en: write the bid-th block. Write operation starts at 0
+      return dev->ops->write(dev, bid, 1, buffer) ;
+}
+
+int breadn ( char *devname, int bid, int n, void *buffer )
+{
+   TypeBlockDevice *dev ;
+
+   // es: n bloques consecutivos en una sola petición al backend
+   // en: n consecutive blocks in a single request to the backend
+   dev = bdev_get(devname) ;
+   if ( (NULL == dev) || (n <= 0) ) {
+       return -1 ;
+   }
+
+   return dev->ops->read(dev, bid, n, buffer) ;
+}
+
+int bwriten ( char *devname, int bid, int n, void *buffer )
+{
+   TypeBlockDevice *dev ;
+
+   // es: n bloques consecutivos en una sola petición al backend
+   // en: n consecutive blocks in a single request to the backend
+   dev = bdev_get(devname) ;
+   if ( (NULL == dev) || (n <= 0) ) {
+       return -1 ;
+   }
+
+   return dev->ops->write(dev, bid, n, buffer) ;
+}
+
+
+/*
+ *  es: E/S asíncrona de bloques
+ *  en: Asynchronous block I/O
+ *
+ *  es: baio_submit() encola una petición (hasta queue_depth en curso),
+ *      baio_poll() recoge las completadas sin bloquear y baio_wait() espera
+ *      a una concreta. Al recogerse, una petición se marca como done y se
+ *      llama a su callback (en el hilo que llama a poll/wait).
+ *      Motores: io_uring (dispositivos con descriptor) o un conjunto de hilos.
+ *      Las peticiones que io_uring no puede hacer van a los hilos.
+ *      baio_notify() fija un eventfd que se avisa en cada completada.
+ *  en: baio_submit() queues a request (up to queue_depth in flight),
+ *      baio_poll() reaps completed ones without blocking and baio_wait()
+ *      waits for a given one. When reaped, a request is marked as done and
+ *      its callback is called (in the thread calling poll/wait).
+ *      Engines: io_uring (devices with a descriptor) or a pool of threads.
+ *      Requests io_uring cannot do go to the threads.
+ *      baio_notify() sets an eventfd that is notified on each completion.
+ */
+
+struct {
+    int   engine ;            // es: 0: sin inicializar
+                              // en: 0: not initialized
+    int   on_demand ;         // es: 1: lo ha iniciado baio_submit (baio_release lo para)
+                              // en: 1: started by baio_submit (baio_release stops it)
+    pthread_mutex_t init_lock ; // es: inicio y parada
+                                // en: start and stop
+    int   queue_depth ;
+    int   inflight ;          // es: enviadas y no recogidas
+                              // en: submitted and not reaped
+
+    pthread_mutex_t lock ;
+    pthread_cond_t  cond_queue ;
+    pthread_cond_t  cond_done ;
+
+    // es: completadas sin recoger (motor de hilos y completadas al enviarse)
+    // en: completed and not reaped (thread engine and completed on submit)
+    TypeBlockRequest **done ;
+    int   done_head, done_count ;
+
+    // es: motor de hilos
+    // en: thread engine
+    TypeBlockRequest **queue ;
+    int   queue_head, queue_count ;
+    pthread_t workers[BAIO_WORKERS] ;
+    int   stop ;
+
+    // es: motor io_uring
+    // en: io_uring engine
+    int   ring_fd ;
+    unsigned *sq_tail, *sq_mask, *sq_array ;
+    unsigned *cq_head, *cq_tail, *cq_mask ;
+    struct io_uring_sqe *sqes ;
+    struct io_uring_cqe *cqes ;
+    void   *sq_ptr, *cq_ptr ;
+    size_t  sq_len, cq_len, sqes_len ;
+    unsigned to_submit ;
+    int   ring_inflight ;     // es: enviadas por io_uring y no recogidas
+                              // en: submitted through io_uring and not reaped
+
+    int   notify_fd ;         // es: eventfd a avisar en cada completada (-1: ninguno)
+                              // en: eventfd notified on each completed request (-1: none)
+} baio = {
+    .notify_fd  = -1,
+    .init_lock  = PTHREAD_MUTEX_INITIALIZER,
+    .lock       = PTHREAD_MUTEX_INITIALIZER,   // es: una sola vez (sobreviven a baio_finalize)
+    .cond_queue = PTHREAD_COND_INITIALIZER,    // en: only once (they outlive baio_finalize)
+    .cond_done  = PTHREAD_COND_INITIALIZER
+} ;
+
+int baio_sync ( TypeBlockRequest *request )
+{
+   TypeBlockDevice *dev ;
+
+   // es: hacer la petición con el backend del dispositivo
+   // en: do the request with the device backend
+   dev = bdev_get(request->devname) ;
+   if (NULL == dev) {
+       return -1 ;
+   }
+   if (request->is_write) {
+       return dev->ops->write(dev, request->bid, 1, request->buffer) ;
+   }
+   return dev->ops->read(dev, request->bid, 1, request->buffer) ;
+}
+
+void baio_complete ( TypeBlockRequest *request )
+{
+   // es: dejar la petición en la lista de completadas
+   // en: put the request in the completed list
+   pthread_mutex_lock(&(baio.lock)) ;
+   baio.done[(baio.done_head + baio.done_count) % baio.queue_depth] = request ;
+   baio.done_count++ ;
+   if (-1 != baio.notify_fd) {
+       eventfd_write(baio.notify_fd, 1) ;
+   }
+   pthread_cond_signal(&(baio.cond_done)) ;
+   pthread_mutex_unlock(&(baio.lock)) ;
+}
+
+void baio_finish ( TypeBlockRequest *request )
+{
+   // es: petición recogida
+   // en: request reaped
+   baio.inflight-- ;
+   request->done = 1 ;
+   if (NULL != request->callback) {
+       request->callback(request) ;
+   }
+}
+
+void *baio_worker ( void *arg )
+{
+   TypeBlockRequest *request ;
+
+   for (;;)
+   {
+        // es: esperar una petición
+        // en: wait for a request
+        pthread_mutex_lock(&(baio.lock)) ;
+        while ( (0 == baio.queue_count) && (! baio.stop) ) {
+            pthread_cond_wait(&(baio.cond_queue), &(baio.lock)) ;
+        }
+        if (0 == baio.queue_count) {
+            pthread_mutex_unlock(&(baio.lock)) ;
+            return NULL ;
+        }
+        request = baio.queue[baio.queue_head] ;
+        baio.queue_head = (baio.queue_head + 1) % baio.queue_depth ;
+        baio.queue_count-- ;
+        pthread_mutex_unlock(&(baio.lock)) ;
 
-   // 3) es: devuelve ok
-   // 3) en: return ok
-      return ret ;
+        // es: hacerla y dejarla en completadas
+        // en: do it and put it in the completed list
+        request->result = baio_sync(request) ;
+        baio_complete(request) ;
+   }
 }
 
+int baio_uring_setup ( int entries )
+{
+   struct io_uring_params p ;
+
+   memset(&p, 0, sizeof(p)) ;
+   baio.ring_fd = syscall(__NR_io_uring_setup, entries, &p) ;
+   if (baio.ring_fd < 0) {
+       return -1 ;
+   }
+
+   // es: proyectar en memoria las colas de envío y de completadas y el array de SQEs
+   // en: map the submission and completion rings and the SQE array
+   baio.sq_len   = p.sq_off.array + p.sq_entries * sizeof(unsigned) ;
+   baio.cq_len   = p.cq_off.cqes  + p.cq_entries * sizeof(struct io_uring_cqe) ;
+   baio.sqes_len = p.sq_entries * sizeof(struct io_uring_sqe) ;
+   if (p.features & IORING_FEAT_SINGLE_MMAP) {
+       baio.sq_len = baio.cq_len = (baio.sq_len > baio.cq_len) ? baio.sq_len : baio.cq_len ;
+   }
+
+   baio.sq_ptr = mmap(NULL, baio.sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, baio.ring_fd, IORING_OFF_SQ_RING) ;
+   baio.cq_ptr = baio.sq_ptr ;
+   if ( (MAP_FAILED != baio.sq_ptr) && (0 == (p.features & IORING_FEAT_SINGLE_MMAP)) ) {
+       baio.cq_ptr = mmap(NULL, baio.cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, baio.ring_fd, IORING_OFF_CQ_RING) ;
+   }
+   baio.sqes = mmap(NULL, baio.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, baio.ring_fd, IORING_OFF_SQES) ;
+   if ( (MAP_FAILED == baio.sq_ptr) || (MAP_FAILED == baio.cq_ptr) || (MAP_FAILED == baio.sqes) )
+   {
+       if (MAP_FAILED != baio.sqes)   munmap(baio.sqes, baio.sqes_len) ;
+       if ( (MAP_FAILED != baio.cq_ptr) && (baio.cq_ptr != baio.sq_ptr) ) munmap(baio.cq_ptr, baio.cq_len) ;
+       if (MAP_FAILED != baio.sq_ptr) munmap(baio.sq_ptr, baio.sq_len) ;
+       close(baio.ring_fd) ;
+       return -1 ;
+   }
+
+   baio.sq_tail  = (unsigned *)((char *)baio.sq_ptr + p.sq_off.tail) ;
+   baio.sq_mask  = (unsigned *)((char *)baio.sq_ptr + p.sq_off.ring_mask) ;
+   baio.sq_array = (unsigned *)((char *)baio.sq_ptr + p.sq_off.array) ;
+   baio.cq_head  = (unsigned *)((char *)baio.cq_ptr + p.cq_off.head) ;
+   baio.cq_tail  = (unsigned *)((char *)baio.cq_ptr + p.cq_off.tail) ;
+   baio.cq_mask  = (unsigned *)((char *)baio.cq_ptr + p.cq_off.ring_mask) ;
+   baio.cqes     = (struct io_uring_cqe *)((char *)baio.cq_ptr + p.cq_off.cqes) ;
+   baio.to_submit     = 0 ;
+   baio.ring_inflight = 0 ;
+
+   return 1 ;
+}
+
+void baio_uring_close ( void )
+{
+   munmap(baio.sqes, baio.sqes_len) ;
+   if (baio.cq_ptr != baio.sq_ptr) {
+       munmap(baio.cq_ptr, baio.cq_len) ;
+   }
+   munmap(baio.sq_ptr, baio.sq_len) ;
+   close(baio.ring_fd) ;
+}
+
+void baio_workers_stop ( int n )
+{
+   // es: despertar a los n primeros hilos para que terminen y esperarlos
+   // en: wake up the first n threads so that they finish and wait for them
+   pthread_mutex_lock(&(baio.lock)) ;
+   baio.stop = 1 ;
+   pthread_cond_broadcast(&(baio.cond_queue)) ;
+   pthread_mutex_unlock(&(baio.lock)) ;
+   for (int i=0; i<n; i++) {
+        pthread_join(baio.workers[i], NULL) ;
+   }
+}
+
+int baio_reap ( int wait )
+{
+   TypeBlockRequest *request ;
+   TypeBlockRequest *reaped[BAIO_QUEUE_DEPTH_MAX] ;
+   int n = 0 ;
+
+   if (0 == baio.inflight) {
+       return -1 ;
+   }
+
+   // es: completadas por los hilos (se espera aquí si no hay ninguna en io_uring)
+   // en: completed by the threads (waiting here if there is none in io_uring)
+   pthread_mutex_lock(&(baio.lock)) ;
+   while ( (wait) && (0 == baio.ring_inflight) && (0 == baio.done_count) ) {
+       pthread_cond_wait(&(baio.cond_done), &(baio.lock)) ;
+   }
+   while (baio.done_count > 0)
+   {
+       reaped[n++] = baio.done[baio.done_head] ;
+       baio.done_head = (baio.done_head + 1) % baio.queue_depth ;
+       baio.done_count-- ;
+   }
+   pthread_mutex_unlock(&(baio.lock)) ;
+
+   // es: io_uring: enviar los SQEs pendientes y recoger CQEs (bloquea si se espera y no hay ninguna)
+   // en: io_uring: submit the pending SQEs and reap CQEs (blocks if waiting and there is none)
+   if (BAIO_ENGINE_URING == baio.engine)
+   {
+       unsigned head, tail ;
+       int min_complete = ( (wait) && (0 == n) && (baio.ring_inflight > 0) ) ? 1 : 0 ;
+
+       if ( (baio.to_submit > 0) || (min_complete > 0) )
+       {
+           int ret = syscall(__NR_io_uring_enter, baio.ring_fd, baio.to_submit, min_complete,
+                             (min_complete > 0) ? IORING_ENTER_GETEVENTS : 0, NULL, 0) ;
+           if (ret >= 0) {
+               baio.to_submit -= ret ;
+           }
+       }
+
+       head = *(baio.cq_head) ;
+       tail = __atomic_load_n(baio.cq_tail, __ATOMIC_ACQUIRE) ;
+       while (head != tail)
+       {
+            struct io_uring_cqe *cqe = &(baio.cqes[head & *(baio.cq_mask)]) ;
+
+            // es: bloque completo -> ok; si no (EINVAL con O_DIRECT, lectura corta, ...) se repite síncrona
+            // en: full block -> ok; otherwise (EINVAL with O_DIRECT, short read, ...) it is retried synchronously
+            request = (TypeBlockRequest *)(uintptr_t)cqe->user_data ;
+            request->result = (cqe->res == block_size) ? 1 : baio_sync(request) ;
+            reaped[n++] = request ;
+            baio.ring_inflight-- ;
+            head++ ;
+       }
+       __atomic_store_n(baio.cq_head, head, __ATOMIC_RELEASE) ;
+   }
+
+   for (int i=0; i<n; i++) {
+        baio_finish(reaped[i]) ;
+   }
+
+   return n ;
+}
+
+int baio_stop ( void )
+{
+   if (0 == baio.engine) {
+       return 1 ;
+   }
+
+   // es: esperar a las peticiones en curso
+   // en: wait for the requests in flight
+   while (baio.inflight > 0) {
+       baio_reap(1) ;
+   }
+
+   if (BAIO_ENGINE_URING == baio.engine) {
+       baio_uring_close() ;
+   }
+   baio_workers_stop(BAIO_WORKERS) ;
+
+   free(baio.done) ;
+   free(baio.queue) ;
+   baio.engine    = 0 ;
+   baio.on_demand = 0 ;
+
+   return 1 ;
+}
+
+int baio_start ( int queue_depth, int engine )
+{
+   // es: no se cambia con peticiones en curso
+   // en: not changed with requests in flight
+   if ( (0 != baio.engine) && (baio_stop() < 0) ) {
+       return -1 ;
+   }
+   if (queue_depth <= 0) {
+       queue_depth = BAIO_QUEUE_DEPTH ;
+   }
+   if (queue_depth > BAIO_QUEUE_DEPTH_MAX) {
+       return -1 ;
+   }
+
+   baio.queue_depth = queue_depth ;
+   baio.inflight    = 0 ;
+   baio.done_head   = baio.done_count  = 0 ;
+   baio.queue_head  = baio.queue_count = 0 ;
+   baio.stop        = 0 ;
+   baio.ring_inflight = 0 ;
+   baio.done  = malloc(queue_depth * sizeof(TypeBlockRequest *)) ;
+   baio.queue = malloc(queue_depth * sizeof(TypeBlockRequest *)) ;
+   if ( (NULL == baio.done) || (NULL == baio.queue) ) {
+       free(baio.done) ;
+       free(baio.queue) ;
+       return -1 ;
+   }
+
+   // es: io_uring si se puede, si no hilos (los hilos se usan también con io_uring
+   //     para los dispositivos sin descriptor: red, stripe, ...)
+   // en: io_uring if possible, threads otherwise (the threads are also used with io_uring
+   //     for devices without a descriptor: network, stripe, ...)
+   if ( (BAIO_ENGINE_THREADS != engine) && (baio_uring_setup(queue_depth) >= 0) ) {
+       engine = BAIO_ENGINE_URING ;
+   }
+   else if (BAIO_ENGINE_URING == engine) {
+       free(baio.done) ;
+       free(baio.queue) ;
+       return -1 ;
+   }
+
+   // es: sin hilos las peticiones encoladas no terminarían nunca -> deshacer todo
+   // en: without threads the queued requests would never complete -> undo everything
+   for (int i=0; i<BAIO_WORKERS; i++)
+   {
+        if (0 != pthread_create(&(baio.workers[i]), NULL, baio_worker, NULL))
+        {
+            baio_workers_stop(i) ;
+            if (BAIO_ENGINE_URING == engine) {
+                baio_uring_close() ;
+            }
+            free(baio.done) ;
+            free(baio.queue) ;
+            return -1 ;
+        }
+   }
+
+   // es: el eventfd de baio_notify (si lo hay) también avisa de las completadas por io_uring
+   // en: the baio_notify eventfd (if any) is also notified of the ones completed by io_uring
+   if ( (BAIO_ENGINE_URING == engine) && (-1 != baio.notify_fd) ) {
+       syscall(__NR_io_uring_register, baio.ring_fd, IORING_REGISTER_EVENTFD, &(baio.notify_fd), 1) ;
+   }
+
+   // es: publicarlo al final (baio_submit lo lee sin cerrojo)
+   // en: publish it at the end (baio_submit reads it without the lock)
+   engine = (BAIO_ENGINE_URING == engine) ? BAIO_ENGINE_URING : BAIO_ENGINE_THREADS ;
+   __atomic_store_n(&(baio.engine), engine, __ATOMIC_RELEASE) ;
+   return engine ;
+}
+
+int baio_init ( int queue_depth, int engine )
+{
+   int ret ;
+
+   pthread_mutex_lock(&(baio.init_lock)) ;
+   ret = baio_start(queue_depth, engine) ;
+   if (ret >= 0) {
+       baio.on_demand = 0 ;
+   }
+   pthread_mutex_unlock(&(baio.init_lock)) ;
+
+   return ret ;
+}
+
+int baio_engine ( void )
+{
+   return baio.engine ;
+}
+
+int baio_notify ( int fd )
+{
+   // es: cambiar el eventfd a avisar (también el registrado en io_uring, si está en marcha)
+   // en: change the eventfd to notify (also the one registered in io_uring, if running)
+   pthread_mutex_lock(&(baio.init_lock)) ;
+   if (BAIO_ENGINE_URING == baio.engine)
+   {
+       if (-1 != baio.notify_fd) {
+           syscall(__NR_io_uring_register, baio.ring_fd, IORING_UNREGISTER_EVENTFD, NULL, 0) ;
+       }
+       if (-1 != fd) {
+           syscall(__NR_io_uring_register, baio.ring_fd, IORING_REGISTER_EVENTFD, &fd, 1) ;
+       }
+   }
+   pthread_mutex_lock(&(baio.lock)) ;
+   baio.notify_fd = fd ;
+   pthread_mutex_unlock(&(baio.lock)) ;
+   pthread_mutex_unlock(&(baio.init_lock)) ;
+
+   return 1 ;
+}
+
+void baio_queue ( TypeBlockRequest *request )
+{
+   // es: encolar para un hilo
+   // en: queue for a thread
+   pthread_mutex_lock(&(baio.lock)) ;
+   baio.queue[(baio.queue_head + baio.queue_count) % baio.queue_depth] = request ;
+   baio.queue_count++ ;
+   pthread_cond_signal(&(baio.cond_queue)) ;
+   pthread_mutex_unlock(&(baio.lock)) ;
+}
+
+int baio_submit ( TypeBlockRequest *request )
+{
+   TypeBlockDevice *dev ;
+   unsigned tail, index ;
+
+   // es: arrancar el motor la primera vez (una sola vez aunque envíen varios hilos)
+   // en: start the engine the first time (only once even if several threads submit)
+   if (0 == __atomic_load_n(&(baio.engine), __ATOMIC_ACQUIRE))
+   {
+       pthread_mutex_lock(&(baio.init_lock)) ;
+       if ( (0 == baio.engine) && (baio_start(0, BAIO_ENGINE_AUTO) >= 0) ) {
+           baio.on_demand = 1 ;
+       }
+       pthread_mutex_unlock(&(baio.init_lock)) ;
+       if (0 == __atomic_load_n(&(baio.engine), __ATOMIC_ACQUIRE)) {
+           return -1 ;
+       }
+   }
+
+   // es: cola llena -> recoger completadas antes de volver a enviar
+   // en: full queue -> reap completed requests before submitting again
+   if (baio.inflight >= baio.queue_depth) {
+       return -1 ;
+   }
+   request->done   = 0 ;
+   request->result = -1 ;
+   baio.inflight++ ;
+
+   // es: motor de hilos: encolar para un hilo
+   // en: thread engine: queue for a thread
+   if (BAIO_ENGINE_THREADS == baio.engine) {
+       baio_queue(request) ;
+       return 1 ;
+   }
+
+   // es: io_uring solo con descriptor y (con O_DIRECT) buffer alineado; si no, a un hilo
+   // en: io_uring only with a descriptor and (with O_DIRECT) an aligned buffer; otherwise to a thread
+   dev = bdev_get(request->devname) ;
+   if ( (NULL == dev) || (! dev->ops->fd_io) ||
+        ( (-1 != dev->fd_buffered) && (0 != ((uintptr_t)request->buffer % BLOCK_ALIGN)) ) )
+   {
+       baio_queue(request) ;
+       return 1 ;
+   }
+
+   // es: rellenar un SQE (se envían juntos en el siguiente poll/wait)
+   // en: fill a SQE (they are submitted together on the next poll/wait)
+   tail  = *(baio.sq_tail) ;
+   index = tail & *(baio.sq_mask) ;
+   memset(&(baio.sqes[index]), 0, sizeof(struct io_uring_sqe)) ;
+   baio.sqes[index].opcode    = request->is_write ? IORING_OP_WRITE : IORING_OP_READ ;
+   baio.sqes[index].fd        = dev->fd ;
+   baio.sqes[index].off       = (uint64_t)request->bid * block_size ;
+   baio.sqes[index].addr      = (uint64_t)(uintptr_t)request->buffer ;
+   baio.sqes[index].len       = block_size ;
+   baio.sqes[index].user_data = (uint64_t)(uintptr_t)request ;
+   baio.sq_array[index] = index ;
+   __atomic_store_n(baio.sq_tail, tail + 1, __ATOMIC_RELEASE) ;
+   baio.to_submit++ ;
+   baio.ring_inflight++ ;
+
+   return 1 ;
+}
+
+int baio_poll ( void )
+{
+   // es: recoger las completadas sin bloquear
+   // en: reap completed requests without blocking
+   if (0 == baio.engine) {
+       return 0 ;
+   }
+
+   return (baio.inflight > 0) ? baio_reap(0) : 0 ;
+}
+
+int baio_wait ( TypeBlockRequest *request )
+{
+   int n = 0 ;
+
+   // es: NULL -> esperar a cualquiera, si no -> esperar a esa petición
+   // en: NULL -> wait for any request, otherwise -> wait for that request
+   while ( (NULL == request) ? (0 == n) : (! request->done) )
+   {
+       int ret = baio_reap(1) ;
+       if (ret < 0) {
+           return -1 ;
+       }
+       n += ret ;
+   }
+
+   return (NULL == request) ? n : request->result ;
+}
+
+int baio_finalize ( void )
+{
+   int ret ;
+
+   pthread_mutex_lock(&(baio.init_lock)) ;
+   ret = baio_stop() ;
+   pthread_mutex_unlock(&(baio.init_lock)) ;
+
+   return ret ;
+}
+
+int baio_release ( void )
+{
+   int ret = 1 ;
+
+   // es: parar el motor solo si lo inició baio_submit (no si se llamó a baio_init)
+   // en: stop the engine only if baio_submit started it (not if baio_init was called)
+   pthread_mutex_lock(&(baio.init_lock)) ;
+   if (baio.on_demand) {
+       ret = baio_stop() ;
+   }
+   pthread_mutex_unlock(&(baio.init_lock)) ;
+
+   return ret ;
+}
@@ -28,12 +28,104 @@
 #include <string.h>
 #include <stdint.h>
 
-#define DISK        "disk.dat"
-#define BLOCK_SIZE  1024
+#define DISK            "disk.dat"
+#define BLOCK_SIZE      1024          /* Tamaño de bloque por defecto / Default block size */
+#define BLOCK_SIZE_MIN  1024          /* Potencia de 2 entre mín. y máx. / Power of 2 between min. and max. */
+#define BLOCK_SIZE_MAX  (64*1024)
 
-int bread  ( char *devname, int bid, void *buffer ) ;
-int bwrite ( char *devname, int bid, void *buffer ) ;
+#define BLOCK_ALIGN     4096          /* Alineamiento de los buffers de E/S (página) / I/O buffer alignment (page) */
+#define BLOCK_DEVICES   16            /* Dispositivos abiertos a la vez / Devices open at the same time */
+#define BPOOL_BUFFERS   32            /* Buffers reutilizables en la reserva / Reusable buffers in the pool */
 
+#define DEVICE_NAME_LENGTH  255       /* "[backend:]path" (p.ej. / e.g. "direct:disk.dat", "unix:nanofs.sock") */
 
-#endif
+#define STRIPE_MEMBERS      8         /* "stripe:<unidad KiB>[+<cabecera KiB>]:<disp.>,<disp.>,..." */
+                                      /* "stripe:<unit KiB>[+<head KiB>]:<dev>,<dev>,..." */
+
+int bsetsize ( int size ) ;
+int bgetsize ( void ) ;
+
+int bread    ( char *devname, int bid, void *buffer ) ;
+int bwrite   ( char *devname, int bid, void *buffer ) ;
+int breadn   ( char *devname, int bid, int n, void *buffer ) ;  /* n bloques consecutivos */
+int bwriten  ( char *devname, int bid, int n, void *buffer ) ;  /* n consecutive blocks */
+int bclose   ( char *devname ) ;
+
+void *bpool_get ( size_t size ) ;
+void  bpool_put ( void *buffer ) ;
+
+
+/*
+ *  es: E/S asíncrona de bloques (submit + poll + wait)
+ *  en: Asynchronous block I/O (submit + poll + wait)
+ */
+
+#define BAIO_QUEUE_DEPTH      32      /* Peticiones en curso por defecto / Default requests in flight */
+#define BAIO_QUEUE_DEPTH_MAX  4096
+#define BAIO_WORKERS          4       /* Hilos del motor de hilos / Threads of the thread engine */
+
+#define BAIO_ENGINE_AUTO      0       /* io_uring si el núcleo lo permite, si no hilos */
+#define BAIO_ENGINE_URING     1       /* io_uring if the kernel allows it, threads otherwise */
+#define BAIO_ENGINE_THREADS   2
+
+typedef struct block_request {
+    char *devname ;               /* Dispositivo / Device */
+    int   bid ;                   /* Bloque / Block */
+    void *buffer ;                /* Un bloque de datos / One block of data */
+    int   is_write ;              /* 0: lectura, 1: escritura / 0: read, 1: write */
+    void (*callback) ( struct block_request *request ) ;  /* Opcional / Optional */
+    void *user_data ;
+    int   result ;                /* 1: ok, -1: error (al completarse / on completion) */
+    int   done ;                  /* 0: en curso, 1: completada / 0: in flight, 1: completed */
+} TypeBlockRequest ;
+
+int baio_init     ( int queue_depth, int engine ) ;
+int baio_finalize ( void ) ;
+int baio_release  ( void ) ;  /* baio_finalize si lo inició baio_submit / baio_finalize if baio_submit started it */
+int baio_engine   ( void ) ;
+int baio_notify   ( int fd ) ;  /* eventfd a avisar en cada completada (-1: ninguno) */
+                                /* eventfd notified on each completed request (-1: none) */
+int baio_submit   ( TypeBlockRequest *request ) ;
+int baio_poll     ( void ) ;
+int baio_wait     ( TypeBlockRequest *request ) ;
 
+
+/*
+ *  es: Protocolo del servidor de bloques (blockd)
+ *  en: Block server protocol (blockd)
+ *
+ *  es: Binario, en orden de red. Cada petición es una cabecera seguida (en
+ *      escrituras) de count*blockSize bytes; cada respuesta es una cabecera
+ *      seguida (en lecturas con éxito) de count*blockSize bytes. Se pueden
+ *      enviar muchas peticiones sin esperar: las respuestas llegan en orden.
+ *  en: Binary, in network byte order. Each request is a header followed (on
+ *      writes) by count*blockSize bytes; each reply is a header followed (on
+ *      successful reads) by count*blockSize bytes. Many requests may be sent
+ *      without waiting: replies arrive in order.
+ */
+
+#define BLOCKD_MAGIC    0x4e424b44    /* "NBKD" */
+#define BLOCKD_READ     1
+#define BLOCKD_WRITE    2
+#define BLOCKD_MAX_IO   (1024*1024)   /* Máximo count*blockSize / Maximum count*blockSize */
+
+typedef struct {
+    uint32_t magic ;
+    uint32_t id ;                 /* Consecutivo por conexión / Consecutive per connection */
+    uint32_t op ;                 /* BLOCKD_READ o BLOCKD_WRITE / BLOCKD_READ or BLOCKD_WRITE */
+    uint32_t blockSize ;
+    uint32_t bid ;
+    uint32_t count ;              /* Bloques consecutivos / Consecutive blocks */
+} TypeBlockdRequest ;
+
+typedef struct {
+    uint32_t magic ;
+    uint32_t id ;                 /* El de la petición / The request one */
+     int32_t result ;             /* 1: ok, -1: error */
+} TypeBlockdReply ;
+
+int bdev_sock_connect ( char *address, int is_server ) ;  /* "unix:path" o / or "tcp:[host:]port" */
+int bdev_sock_io      ( int fd, int is_send, void *buffer, size_t size, int flags ) ;
+
+
+#endif
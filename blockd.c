@@ -0,0 +1,163 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "block.h"
+
+
+/*
+ *  es: Servidor de bloques: exporta un dispositivo ("[backend:]path") por un
+ *      socket Unix o TCP a los clientes "unix:" y "tcp:" de block.c. Un hilo
+ *      por conexión atiende las peticiones en orden.
+ *  en: Block server: exports a device ("[backend:]path") through a Unix or
+ *      TCP socket to the "unix:" and "tcp:" clients of block.c. One thread
+ *      per connection serves the requests in order.
+ */
+
+char *blockd_devname ;
+
+int blockd_serve ( int fd, char *buffer )
+{
+   TypeBlockdRequest req ;
+   TypeBlockdReply   rep ;
+   uint32_t bs, bid, count ;
+   size_t   size ;
+   int      ret ;
+
+   for (;;)
+   {
+        // es: cabecera (fin de conexión -> terminar)
+        // en: header (end of connection -> finish)
+        if (bdev_sock_io(fd, 0, &req, sizeof(req), 0) < 0) {
+            return 1 ;
+        }
+        bs    = ntohl(req.blockSize) ;
+        bid   = ntohl(req.bid) ;
+        count = ntohl(req.count) ;
+        size  = (size_t)count * bs ;
+        if ( (ntohl(req.magic) != BLOCKD_MAGIC) || (bs < BLOCK_SIZE_MIN) || (bs > BLOCK_SIZE_MAX) ||
+             (0 != (bs & (bs - 1))) || (0 == count) || (size > BLOCKD_MAX_IO) ) {
+            return -1 ;
+        }
+
+        // es: el dispositivo se usa en bloques de BLOCK_SIZE_MIN (cada cliente puede usar otro tamaño)
+        // en: the device is used in blocks of BLOCK_SIZE_MIN (each client may use another size)
+        bid   = bid   * (bs / BLOCK_SIZE_MIN) ;
+        count = count * (bs / BLOCK_SIZE_MIN) ;
+        switch (ntohl(req.op))
+        {
+            case BLOCKD_READ:
+                 ret = breadn(blockd_devname, bid, count, buffer) ;
+                 break ;
+            case BLOCKD_WRITE:
+                 if (bdev_sock_io(fd, 0, buffer, size, 0) < 0) {
+                     return -1 ;
+                 }
+                 ret = bwriten(blockd_devname, bid, count, buffer) ;
+                 break ;
+            default:
+                 return -1 ;
+        }
+
+        // es: respuesta (+ datos leídos)
+        // en: reply (+ data read)
+        rep.magic  = htonl(BLOCKD_MAGIC) ;
+        rep.id     = req.id ;
+        rep.result = htonl((ret < 0) ? -1 : 1) ;
+        if (bdev_sock_io(fd, 1, &rep, sizeof(rep), ( (ret >= 0) && (BLOCKD_READ == ntohl(req.op)) ) ? MSG_MORE : 0) < 0) {
+            return -1 ;
+        }
+        if ( (ret >= 0) && (BLOCKD_READ == ntohl(req.op)) && (bdev_sock_io(fd, 1, buffer, size, 0) < 0) ) {
+            return -1 ;
+        }
+   }
+}
+
+void *blockd_connection ( void *arg )
+{
+   int   fd = (int)(intptr_t)arg ;
+   char *buffer ;
+
+   // es: un buffer alineado por conexión (para backends con O_DIRECT)
+   // en: one aligned buffer per connection (for backends with O_DIRECT)
+   buffer = bpool_get(BLOCKD_MAX_IO) ;
+   if (NULL != buffer) {
+       blockd_serve(fd, buffer) ;
+       bpool_put(buffer) ;
+   }
+   close(fd) ;
+
+   return NULL ;
+}
+
+int main ( int argc, char *argv[] )
+{
+   pthread_t thread ;
+   char *probe ;
+   int   listen_fd, fd ;
+
+   if (argc != 3) {
+       printf("Usage: %s <[backend:]path> <unix:path | tcp:[host:]port>\n", argv[0]) ;
+       return -1 ;
+   }
+   blockd_devname = argv[1] ;
+
+   // es: abrir el dispositivo ya para detectar errores al arrancar
+   // en: open the device now to detect errors on start
+   bsetsize(BLOCK_SIZE_MIN) ;
+   probe = bpool_get(BLOCK_SIZE_MIN) ;
+   if ( (NULL == probe) || (bread(blockd_devname, 0, probe) < 0) ) {
+       printf("blockd: cannot open %s\n", blockd_devname) ;
+       return -1 ;
+   }
+   bpool_put(probe) ;
+
+   listen_fd = bdev_sock_connect(argv[2], 1) ;
+   if (listen_fd < 0) {
+       printf("blockd: cannot listen on %s\n", argv[2]) ;
+       return -1 ;
+   }
+   signal(SIGPIPE, SIG_IGN) ;
+   printf("blockd: serving %s on %s\n", blockd_devname, argv[2]) ;
+   fflush(stdout) ;
+
+   // es: un hilo por conexión
+   // en: one thread per connection
+   for (;;)
+   {
+        fd = accept(listen_fd, NULL, NULL) ;
+        if (fd < 0) {
+            continue ;
+        }
+        if (0 != pthread_create(&thread, NULL, blockd_connection, (void *)(intptr_t)fd)) {
+            close(fd) ;
+            continue ;
+        }
+        pthread_detach(thread) ;
+   }
+
+   return 0 ;
+}
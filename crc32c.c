@@ -0,0 +1,174 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "crc32c.h"
+
+#include <string.h>
+#include <pthread.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#endif
+
+
+/*
+ *  es: Versión software (slicing-by-8)
+ *  en: Software version (slicing-by-8)
+ */
+
+#define CRC32C_POLY 0x82F63B78
+
+static uint32_t       crc32c_table[8][256] ;
+static pthread_once_t crc32c_table_once = PTHREAD_ONCE_INIT ;
+
+static void crc32c_init_table ( void )
+{
+    uint32_t c ;
+
+    // es: tabla básica byte a byte
+    // en: basic byte-at-a-time table
+    for (int i=0; i<256; i++)
+    {
+         c = i ;
+         for (int j=0; j<8; j++) {
+              c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : (c >> 1) ;
+         }
+         crc32c_table[0][i] = c ;
+    }
+
+    // es: tablas derivadas para procesar 8 bytes por iteración
+    // en: derived tables to process 8 bytes per iteration
+    for (int i=0; i<256; i++)
+    {
+         c = crc32c_table[0][i] ;
+         for (int k=1; k<8; k++) {
+              c = crc32c_table[0][c & 0xFF] ^ (c >> 8) ;
+              crc32c_table[k][i] = c ;
+         }
+    }
+}
+
+static uint32_t crc32c_sw ( uint32_t crc, const uint8_t *p, size_t size )
+{
+    uint32_t lo, hi ;
+
+    // es: una sola vez aunque lo llamen varios hilos a la vez (fsck, baio, stripe)
+    // en: only once even if several threads call it at the same time (fsck, baio, stripe)
+    pthread_once(&crc32c_table_once, crc32c_init_table) ;
+
+    while (size >= 8)
+    {
+         memcpy(&lo, p,   4) ;
+         memcpy(&hi, p+4, 4) ;
+         lo ^= crc ;
+         crc = crc32c_table[7][ lo        & 0xFF] ^
+               crc32c_table[6][(lo >>  8) & 0xFF] ^
+               crc32c_table[5][(lo >> 16) & 0xFF] ^
+               crc32c_table[4][ lo >> 24        ] ^
+               crc32c_table[3][ hi        & 0xFF] ^
+               crc32c_table[2][(hi >>  8) & 0xFF] ^
+               crc32c_table[1][(hi >> 16) & 0xFF] ^
+               crc32c_table[0][ hi >> 24        ] ;
+         p    += 8 ;
+         size -= 8 ;
+    }
+
+    while (size > 0)
+    {
+         crc = crc32c_table[0][(crc ^ *p) & 0xFF] ^ (crc >> 8) ;
+         p++ ;
+         size-- ;
+    }
+
+    return crc ;
+}
+
+
+/*
+ *  es: Versión hardware (SSE4.2)
+ *  en: Hardware version (SSE4.2)
+ */
+
+#if defined(__x86_64__) || defined(__i386__)
+
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hw ( uint32_t crc, const uint8_t *p, size_t size )
+{
+#if defined(__x86_64__)
+    uint64_t c = crc ;
+    uint64_t v ;
+
+    while (size >= 8)
+    {
+         memcpy(&v, p, 8) ;
+         c     = _mm_crc32_u64(c, v) ;
+         p    += 8 ;
+         size -= 8 ;
+    }
+    crc = (uint32_t)c ;
+#endif
+
+    while (size > 0)
+    {
+         crc = _mm_crc32_u8(crc, *p) ;
+         p++ ;
+         size-- ;
+    }
+
+    return crc ;
+}
+
+#endif
+
+
+/*
+ *  es: Interfaz
+ *  en: Interface
+ */
+
+int crc32c_hardware ( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    static int has_sse42 = -1 ;
+
+    if (-1 == has_sse42) {
+        __builtin_cpu_init() ;
+        has_sse42 = __builtin_cpu_supports("sse4.2") ? 1 : 0 ;
+    }
+
+    return has_sse42 ;
+#else
+    return 0 ;
+#endif
+}
+
+uint32_t crc32c ( uint32_t crc, const void *buffer, size_t size )
+{
+    crc = ~crc ;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (crc32c_hardware()) {
+        return ~crc32c_hw(crc, buffer, size) ;
+    }
+#endif
+
+    return ~crc32c_sw(crc, buffer, size) ;
+}
+
@@ -0,0 +1,41 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _CRC32C_H
+#define _CRC32C_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/*
+ *  es: CRC32C (Castagnoli): instrucción crc32 de SSE4.2 si está disponible,
+ *      o bien "slicing-by-8" por software
+ *  en: CRC32C (Castagnoli): SSE4.2 crc32 instruction when available,
+ *      slicing-by-8 software fallback otherwise
+ */
+
+uint32_t crc32c          ( uint32_t crc, const void *buffer, size_t size ) ;
+int      crc32c_hardware ( void ) ;
+
+
+#endif
+
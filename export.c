@@ -0,0 +1,291 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "nanofs.h"
+
+
+/*
+ *  es: Exportación en bloque: copia los ficheros de un sistema de ficheros
+ *      (o de una de sus instantáneas) a un directorio del anfitrión, creando
+ *      los subdirectorios de los nombres "dir/fichero". El hilo principal
+ *      lee de nanofs mientras otro escribe los ficheros del anfitrión.
+ *  en: Bulk export: copies the files of a file system (or of one of its
+ *      snapshots) into a host directory, creating the subdirectories of
+ *      "dir/file" names. The main thread reads from nanofs while another
+ *      one writes the host files.
+ */
+
+#define EXPORT_BUFFERS  4                    /* Buffers entre el lector y el escritor / Buffers between the reader and the writer */
+#define EXPORT_CHUNK    (16*BLOCK_SIZE_MAX)  /* Múltiplo de cualquier tamaño de bloque / Multiple of any block size */
+#define EXPORT_PATH     4096
+
+// buffer between the reader and the writer
+typedef struct {
+    char *data ;
+    int   file ;                  /* Índice en files / Index in files */
+    int   length ;                /* Bytes (0: fin de fichero, -1: error de lectura) */
+                                  /* Bytes (0: end of file, -1: read error) */
+} TypeExportBuffer ;
+
+char             files[NUM_INODES][NAME_LENGTH+1] ;
+int              num_files = 0 ;
+char            *export_dir = NULL ;
+int              export_errors = 0 ;
+
+TypeExportBuffer ring[EXPORT_BUFFERS] ;
+int              ring_head = 0 ;  // es: siguiente buffer a llenar / en: next buffer to fill
+int              ring_tail = 0 ;  // es: siguiente buffer a vaciar / en: next buffer to drain
+pthread_mutex_t  ring_lock = PTHREAD_MUTEX_INITIALIZER ;
+pthread_cond_t   ring_cond = PTHREAD_COND_INITIALIZER ;
+
+
+int export_open ( char *name )
+{
+   char path[EXPORT_PATH] ;
+
+   // es: crear los subdirectorios del nombre (si no existen)
+   // en: create the subdirectories of the name (if they do not exist)
+   snprintf(path, sizeof(path), "%s/%s", export_dir, name) ;
+   for (char *p = path + strlen(export_dir) + 1; NULL != (p = strchr(p, '/')); p++)
+   {
+        *p = '\0' ;
+        if ( (mkdir(path, 0755) < 0) && (EEXIST != errno) ) {
+            return -1 ;
+        }
+        *p = '/' ;
+   }
+
+   return open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) ;
+}
+
+void *export_writer ( void *arg )
+{
+   TypeExportBuffer *buf ;
+   int fd = -1 ;
+   int i  = 0 ;
+   int w ;
+
+   while (i < num_files)
+   {
+        // es: esperar un buffer lleno
+        // en: wait for a full buffer
+        pthread_mutex_lock(&ring_lock) ;
+        while (ring_head == ring_tail) {
+            pthread_cond_wait(&ring_cond, &ring_lock) ;
+        }
+        pthread_mutex_unlock(&ring_lock) ;
+        buf = &(ring[ring_tail % EXPORT_BUFFERS]) ;
+
+        // es: se sigue vaciando aunque falle un fichero, para no bloquear al lector
+        // en: buffers are drained even if a file fails, so as not to block the reader
+        if (buf->length < 0) {
+            printf("nanofs_export: cannot read %s\n", files[i]) ;
+            export_errors++ ;
+        }
+        // es: fd == -1 fichero por abrir, fd == -2 fichero fallido (se descarta hasta su final)
+        // en: fd == -1 file not opened yet, fd == -2 failed file (skipped until its end)
+        if ( (-1 == fd) && (buf->length >= 0) )
+        {
+            fd = export_open(files[i]) ;
+            if (fd < 0) {
+                printf("nanofs_export: cannot create %s/%s\n", export_dir, files[i]) ;
+                export_errors++ ;
+                fd = -2 ;
+            }
+        }
+        for (int done = 0; (fd >= 0) && (done < buf->length); done += w)
+        {
+             w = write(fd, buf->data + done, buf->length - done) ;
+             if (w <= 0) {
+                 printf("nanofs_export: cannot write %s/%s\n", export_dir, files[i]) ;
+                 export_errors++ ;
+                 close(fd) ;
+                 fd = -2 ;
+             }
+        }
+        if (buf->length <= 0)
+        {
+            if (fd >= 0) {
+                close(fd) ;
+            }
+            fd = -1 ;
+            i++ ;
+        }
+
+        // es: devolver el buffer al lector
+        // en: give the buffer back to the reader
+        pthread_mutex_lock(&ring_lock) ;
+        ring_tail++ ;
+        pthread_cond_broadcast(&ring_cond) ;
+        pthread_mutex_unlock(&ring_lock) ;
+   }
+
+   return NULL ;
+}
+
+long long export_read ( void )
+{
+   TypeExportBuffer *buf ;
+   long long total = 0 ;
+   int fd, length ;
+
+   for (int i=0; i<num_files; i++)
+   {
+        fd = nanofs_open(files[i]) ;
+
+        do
+        {
+             // es: esperar un buffer libre
+             // en: wait for a free buffer
+             pthread_mutex_lock(&ring_lock) ;
+             while (ring_head - ring_tail == EXPORT_BUFFERS) {
+                 pthread_cond_wait(&ring_cond, &ring_lock) ;
+             }
+             pthread_mutex_unlock(&ring_lock) ;
+
+             // es: llenar el buffer (0 bytes marca el fin del fichero)
+             // en: fill the buffer (0 bytes marks the end of file)
+             buf = &(ring[ring_head % EXPORT_BUFFERS]) ;
+             buf->file   = i ;
+             buf->length = (fd < 0) ? -1 : nanofs_read(fd, buf->data, EXPORT_CHUNK) ;
+             buf->length = (buf->length < 0) ? -1 : buf->length ;
+             length = buf->length ;
+             total += (length > 0) ? length : 0 ;
+
+             pthread_mutex_lock(&ring_lock) ;
+             ring_head++ ;
+             pthread_cond_broadcast(&ring_cond) ;
+             pthread_mutex_unlock(&ring_lock) ;
+        }
+        while (length > 0) ;
+
+        if (fd >= 0) {
+            nanofs_close(fd) ;
+        }
+   }
+
+   return total ;
+}
+
+void export_free_buffers ( void )
+{
+   for (int i=0; i<EXPORT_BUFFERS; i++) {
+        bpool_put(ring[i].data) ;
+        ring[i].data = NULL ;
+   }
+}
+
+int main ( int argc, char *argv[] )
+{
+   struct timespec t1, t2 ;
+   pthread_t writer ;
+   int snapshot_id = -1 ;
+   int position = 0 ;
+   int opt, ret ;
+   long long total ;
+   double secs ;
+
+   while ((opt = getopt(argc, argv, "n:")) != -1)
+   {
+        switch (opt)
+        {
+            case 'n': snapshot_id = atoi(optarg) ; break ;
+            default:
+                 printf("Usage: %s [-n <snapshot>] <host directory> [<[backend:]path>]\n", argv[0]) ;
+                 return 1 ;
+        }
+   }
+   if (optind >= argc) {
+       printf("Usage: %s [-n <snapshot>] <host directory> [<[backend:]path>]\n", argv[0]) ;
+       return 1 ;
+   }
+   export_dir = argv[optind] ;
+   if ( (optind + 1 < argc) && (nanofs_setdev(argv[optind + 1]) < 0) ) {
+       printf("nanofs_export: bad device name %s\n", argv[optind + 1]) ;
+       return 1 ;
+   }
+
+   ret = (snapshot_id < 0) ? nanofs_mount() : nanofs_mount_snapshot(snapshot_id) ;
+   if (ret < 0) {
+       printf("nanofs_export: cannot mount %s\n", (optind + 1 < argc) ? argv[optind + 1] : DISK) ;
+       return 1 ;
+   }
+
+   // es: nombres a exportar (sin rutas absolutas ni "..", para no salir del directorio)
+   // en: names to export (no absolute paths nor "..", so as not to leave the directory)
+   while (nanofs_readdir(&position, files[num_files]) > 0)
+   {
+        char *name = files[num_files] ;
+        if ( ('/' == name[0]) || (! strcmp(name, "..")) || (! strncmp(name, "../", 3)) ||
+             (NULL != strstr(name, "/../")) || ( (strlen(name) >= 3) && (! strcmp(name + strlen(name) - 3, "/..")) ) ) {
+            printf("nanofs_export: skipping %s\n", name) ;
+            export_errors++ ;
+            continue ;
+        }
+        num_files++ ;
+   }
+   if ( (mkdir(export_dir, 0755) < 0) && (EEXIST != errno) ) {
+       printf("nanofs_export: cannot create %s\n", export_dir) ;
+       nanofs_umount() ;
+       return 1 ;
+   }
+
+   for (int i=0; i<EXPORT_BUFFERS; i++) {
+        ring[i].data = bpool_get(EXPORT_CHUNK) ;
+        if (NULL == ring[i].data) {
+            printf("nanofs_export: out of memory\n") ;
+            nanofs_umount() ;
+            export_free_buffers() ;
+            return 1 ;
+        }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1) ;
+   if (pthread_create(&writer, NULL, export_writer, NULL) != 0) {
+       printf("nanofs_export: cannot start the writer thread\n") ;
+       nanofs_umount() ;
+       export_free_buffers() ;
+       return 1 ;
+   }
+   total = export_read() ;
+   pthread_join(writer, NULL) ;
+   clock_gettime(CLOCK_MONOTONIC, &t2) ;
+
+   nanofs_umount() ;
+   export_free_buffers() ;
+   if (export_errors > 0) {
+       return 1 ;
+   }
+
+   secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9 ;
+   printf("nanofs_export: %d files, %lld bytes in %.3f s (%.1f MiB/s)\n",
+          num_files, total, secs, (secs > 0) ? total / secs / (1024*1024) : 0.0) ;
+
+   return 0 ;
+}
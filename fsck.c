@@ -0,0 +1,82 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <unistd.h>
+#include "nanofs.h"
+
+
+/*
+ *  es: Comprobación sin montar: revisa (y con -y repara) los i-nodos, los
+ *      punteros a bloques y los mapas de bloques con varios hilos.
+ *      Código de salida: 0 sin problemas, 1 todos reparados, 4 quedan
+ *      problemas, 8 error.
+ *  en: Offline check: checks (and with -y repairs) the i-nodes, the block
+ *      pointers and the block maps with several threads.
+ *      Exit code: 0 no problems, 1 all repaired, 4 problems left, 8 error.
+ */
+
+int main ( int argc, char *argv[] )
+{
+   TypeFsckReport report ;
+   int repair = 0 ;
+   int num_threads = FSCK_THREADS ;
+   int opt, problems ;
+
+   while ((opt = getopt(argc, argv, "yt:")) != -1)
+   {
+        switch (opt)
+        {
+            case 'y': repair      = 1 ;            break ;
+            case 't': num_threads = atoi(optarg) ; break ;
+            default:
+                 printf("Usage: %s [-y] [-t <threads>] [<[backend:]path>]\n", argv[0]) ;
+                 return 8 ;
+        }
+   }
+   if ( (optind < argc) && (nanofs_setdev(argv[optind]) < 0) ) {
+       printf("nanofs_fsck: bad device name %s\n", argv[optind]) ;
+       return 8 ;
+   }
+
+   problems = nanofs_fsck(repair, num_threads, &report) ;
+   if (problems < 0) {
+       printf("nanofs_fsck: cannot check %s\n", (optind < argc) ? argv[optind] : DISK) ;
+       return 8 ;
+   }
+
+   printf("\n") ;
+   printf("nanofs_fsck: %s\n", (optind < argc) ? argv[optind] : DISK) ;
+   printf(" * i-nodes in use:   %u\n", report.inodesUsed) ;
+   printf(" * blocks in use:    %u\n", report.blocksUsed) ;
+   printf(" * bad i-nodes:      %u\n", report.badInodes) ;
+   printf(" * bad pointers:     %u\n", report.badPointers) ;
+   printf(" * leaked blocks:    %u\n", report.leakedBlocks) ;
+   printf(" * doubly allocated: %u\n", report.doubleBlocks) ;
+   printf(" * checksum errors:  %u\n", report.checksumErrors) ;
+   printf(" * repaired:         %u\n", report.repaired) ;
+
+   if (0 == problems) {
+       return 0 ;
+   }
+   return (report.repaired >= problems) ? 1 : 4 ;
+}
@@ -0,0 +1,375 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+
+
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+#include "nanofs.h"
+
+
+/*
+ *  es: Importación en bloque: copia los ficheros de un directorio del
+ *      anfitrión (y sus subdirectorios, como nombres "dir/fichero") a un
+ *      sistema de ficheros nuevo. Un hilo lee los ficheros del anfitrión
+ *      mientras el principal los escribe en nanofs por tandas de bloques
+ *      completos; los metadatos se escriben una sola vez al desmontar.
+ *  en: Bulk import: copies the files of a host directory (and its
+ *      subdirectories, as "dir/file" names) into a new file system. A
+ *      thread reads the host files while the main one writes them into
+ *      nanofs in batches of full blocks; metadata is written only once
+ *      at umount.
+ */
+
+#define IMPORT_BUFFERS  4     /* Buffers entre el lector y el escritor / Buffers between the reader and the writer */
+#define IMPORT_PATH     4096
+
+// host file
+typedef struct {
+    char  path[IMPORT_PATH] ;
+    char  name[NAME_LENGTH+1] ;
+    off_t size ;
+} TypeImportFile ;
+
+// buffer between the reader and the writer
+typedef struct {
+    char *data ;
+    int   file ;                  /* Índice en files / Index in files */
+    int   length ;                /* Bytes (0: fin de fichero, -1: error de lectura) */
+                                  /* Bytes (0: end of file, -1: read error) */
+} TypeImportBuffer ;
+
+TypeImportFile   files[NUM_INODES] ;
+int              num_files = 0 ;
+
+TypeImportBuffer ring[IMPORT_BUFFERS] ;
+int              ring_head = 0 ;  // es: siguiente buffer a llenar / en: next buffer to fill
+int              ring_tail = 0 ;  // es: siguiente buffer a vaciar / en: next buffer to drain
+int              ring_chunk = 0 ;
+int              ring_stop = 0 ;
+pthread_mutex_t  ring_lock = PTHREAD_MUTEX_INITIALIZER ;
+pthread_cond_t   ring_cond = PTHREAD_COND_INITIALIZER ;
+
+
+int import_scan ( char *dir, char *prefix )
+{
+   char path[IMPORT_PATH], name[IMPORT_PATH] ;
+   struct dirent *entry ;
+   struct stat st ;
+   DIR *d ;
+   int ret = 1 ;
+
+   d = opendir(dir) ;
+   if (NULL == d) {
+       printf("nanofs_import: cannot open %s\n", dir) ;
+       return -1 ;
+   }
+
+   // es: ficheros regulares (los subdirectorios se recorren y su ruta forma parte del nombre)
+   // en: regular files (subdirectories are walked and their path is part of the name)
+   while ( (ret >= 0) && (NULL != (entry = readdir(d))) )
+   {
+        if ( (! strcmp(entry->d_name, ".")) || (! strcmp(entry->d_name, "..")) ) {
+            continue ;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, entry->d_name) ;
+        snprintf(name, sizeof(name), "%s%s", prefix, entry->d_name) ;
+        if (lstat(path, &st) < 0) {
+            continue ;
+        }
+
+        if (S_ISDIR(st.st_mode))
+        {
+            strcat(name, "/") ;
+            ret = import_scan(path, name) ;
+            continue ;
+        }
+        if (! S_ISREG(st.st_mode)) {
+            continue ;
+        }
+
+        if (num_files == NUM_INODES) {
+            printf("nanofs_import: more than %d files\n", NUM_INODES) ;
+            ret = -1 ;
+        }
+        else if (strlen(name) > NAME_LENGTH) {
+            printf("nanofs_import: name longer than %d characters: %s\n", NAME_LENGTH, name) ;
+            ret = -1 ;
+        }
+        else
+        {
+            strcpy(files[num_files].path, path) ;
+            strcpy(files[num_files].name, name) ;
+            files[num_files].size = st.st_size ;
+            num_files++ ;
+        }
+   }
+
+   closedir(d) ;
+   return ret ;
+}
+
+void *import_reader ( void *arg )
+{
+   TypeImportBuffer *buf ;
+   int fd, r, length ;
+   int stop = 0 ;
+
+   for (int i=0; i<num_files; i++)
+   {
+        fd = open(files[i].path, O_RDONLY) ;
+
+        do
+        {
+             // es: esperar un buffer libre
+             // en: wait for a free buffer
+             pthread_mutex_lock(&ring_lock) ;
+             while ( (ring_head - ring_tail == IMPORT_BUFFERS) && (! ring_stop) ) {
+                 pthread_cond_wait(&ring_cond, &ring_lock) ;
+             }
+             stop = ring_stop ;
+             pthread_mutex_unlock(&ring_lock) ;
+             if (stop) {
+                 break ;
+             }
+
+             // es: llenar el buffer (0 bytes marca el fin del fichero)
+             // en: fill the buffer (0 bytes marks the end of file)
+             buf = &(ring[ring_head % IMPORT_BUFFERS]) ;
+             buf->file   = i ;
+             buf->length = (fd < 0) ? -1 : 0 ;
+             while ( (fd >= 0) && (buf->length < ring_chunk) )
+             {
+                  r = read(fd, buf->data + buf->length, ring_chunk - buf->length) ;
+                  if (r <= 0) {
+                      buf->length = (r < 0) ? -1 : buf->length ;
+                      break ;
+                  }
+                  buf->length += r ;
+             }
+
+             length = buf->length ;
+
+             pthread_mutex_lock(&ring_lock) ;
+             ring_head++ ;
+             pthread_cond_broadcast(&ring_cond) ;
+             pthread_mutex_unlock(&ring_lock) ;
+        }
+        while (length > 0) ;
+
+        if (fd >= 0) {
+            close(fd) ;
+        }
+        if (stop) {
+            break ;
+        }
+   }
+
+   return NULL ;
+}
+
+int import_write ( void )
+{
+   TypeImportBuffer *buf ;
+   int fd = -1 ;
+   int i  = 0 ;
+   int ret = 1 ;
+
+   while ( (ret >= 0) && (i < num_files) )
+   {
+        // es: esperar un buffer lleno
+        // en: wait for a full buffer
+        pthread_mutex_lock(&ring_lock) ;
+        while (ring_head == ring_tail) {
+            pthread_cond_wait(&ring_cond, &ring_lock) ;
+        }
+        pthread_mutex_unlock(&ring_lock) ;
+        buf = &(ring[ring_tail % IMPORT_BUFFERS]) ;
+
+        if (fd < 0) {
+            fd = nanofs_creat(files[i].name) ;
+        }
+        if ( (fd < 0) || (buf->length < 0) ) {
+            printf("nanofs_import: cannot import %s\n", files[i].path) ;
+            ret = -1 ;
+        }
+        else if (buf->length > 0) {
+            ret = (nanofs_write(fd, buf->data, buf->length) == buf->length) ? 1 : -1 ;
+            if (ret < 0) {
+                printf("nanofs_import: cannot write %s (file system full?)\n", files[i].name) ;
+            }
+        }
+        else {
+            ret = nanofs_close(fd) ;
+            fd  = -1 ;
+            i++ ;
+        }
+
+        // es: devolver el buffer al lector
+        // en: give the buffer back to the reader
+        pthread_mutex_lock(&ring_lock) ;
+        ring_tail++ ;
+        pthread_cond_broadcast(&ring_cond) ;
+        pthread_mutex_unlock(&ring_lock) ;
+   }
+
+   if (fd >= 0) {
+       nanofs_close(fd) ;
+   }
+   return ret ;
+}
+
+void import_free_buffers ( void )
+{
+   for (int i=0; i<IMPORT_BUFFERS; i++) {
+        bpool_put(ring[i].data) ;
+        ring[i].data = NULL ;
+   }
+}
+
+int main ( int argc, char *argv[] )
+{
+   TypeMkfsOptions options ;
+   struct timespec t1, t2 ;
+   pthread_t reader ;
+   long long data_blocks, total ;
+   int dev_size = 0 ;
+   int opt, ret, fd ;
+   double secs ;
+
+   memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+   while ((opt = getopt(argc, argv, "b:s:c")) != -1)
+   {
+        switch (opt)
+        {
+            case 'b': options.blockSize = atoi(optarg) ;  break ;
+            case 's': dev_size          = atoi(optarg) ;  break ;
+            case 'c': options.features |= F_CHECKSUM ;    break ;
+            default:
+                 printf("Usage: %s [-b <block size>] [-s <blocks>] [-c] <host directory> [<[backend:]path>]\n", argv[0]) ;
+                 return 1 ;
+        }
+   }
+   if (optind >= argc) {
+       printf("Usage: %s [-b <block size>] [-s <blocks>] [-c] <host directory> [<[backend:]path>]\n", argv[0]) ;
+       return 1 ;
+   }
+   if ( (optind + 1 < argc) && (nanofs_setdev(argv[optind + 1]) < 0) ) {
+       printf("nanofs_import: bad device name %s\n", argv[optind + 1]) ;
+       return 1 ;
+   }
+   if (0 == options.blockSize) {
+       options.blockSize = BLOCK_SIZE ;
+   }
+
+   // es: ficheros a importar y bloques de datos que necesitan (más el indirecto)
+   // en: files to import and the data blocks they need (plus the indirect one)
+   if (import_scan(argv[optind], "") < 0) {
+       return 1 ;
+   }
+   data_blocks = 0 ;
+   total = 0 ;
+   for (int i=0; i<num_files; i++)
+   {
+        long long n = (files[i].size + options.blockSize - 1) / options.blockSize ;
+        if (n > 1 + options.blockSize/4) {
+            printf("nanofs_import: %s is larger than %d bytes\n", files[i].path, (1 + options.blockSize/4) * options.blockSize) ;
+            return 1 ;
+        }
+        data_blocks += n + (n > 1) ;
+        total += files[i].size ;
+   }
+
+   // es: tamaño justo (si no se indica): datos + mapas y sumas de control (< 24 bytes por bloque) + fijos
+   // en: just the size needed (if not given): data + maps and checksums (< 24 bytes per block) + fixed ones
+   if (0 == dev_size) {
+       dev_size = data_blocks + (data_blocks * 24 + options.blockSize - 1) / options.blockSize + 8 ;
+   }
+   // es: crear el fichero imagen si no existe (dispositivos de fichero, con o sin "direct:")
+   // en: create the image file if it does not exist (file devices, with or without "direct:")
+   if (optind + 1 < argc)
+   {
+       char *path = argv[optind + 1] ;
+       if (! strncmp(path, "direct:", 7)) {
+           path = path + 7 ;
+       }
+       if ( (NULL == strchr(path, ':')) && ((fd = open(path, O_WRONLY | O_CREAT, 0644)) >= 0) ) {
+           close(fd) ;
+       }
+   }
+   if (nanofs_mkfs_opts(dev_size, &options) < 0) {
+       printf("nanofs_import: cannot create the file system (%d blocks of %d bytes)\n", dev_size, options.blockSize) ;
+       return 1 ;
+   }
+   if (nanofs_mount() < 0) {
+       printf("nanofs_import: cannot mount the new file system\n") ;
+       return 1 ;
+   }
+
+   // es: buffers de tandas completas de escritura (alineados, de la reserva)
+   // en: buffers of full write batches (aligned, from the pool)
+   ring_chunk = WRITE_RUN_BLOCKS * options.blockSize ;
+   for (int i=0; i<IMPORT_BUFFERS; i++) {
+        ring[i].data = bpool_get(ring_chunk) ;
+        if (NULL == ring[i].data) {
+            printf("nanofs_import: out of memory\n") ;
+            nanofs_umount() ;
+            import_free_buffers() ;
+            return 1 ;
+        }
+   }
+
+   clock_gettime(CLOCK_MONOTONIC, &t1) ;
+   if (pthread_create(&reader, NULL, import_reader, NULL) != 0) {
+       printf("nanofs_import: cannot start the reader thread\n") ;
+       nanofs_umount() ;
+       import_free_buffers() ;
+       return 1 ;
+   }
+   ret = import_write() ;
+
+   // es: parar al lector si el escritor ha fallado
+   // en: stop the reader if the writer has failed
+   pthread_mutex_lock(&ring_lock) ;
+   ring_stop = 1 ;
+   pthread_cond_broadcast(&ring_cond) ;
+   pthread_mutex_unlock(&ring_lock) ;
+   pthread_join(reader, NULL) ;
+
+   if (nanofs_umount() < 0) {
+       ret = -1 ;
+   }
+   clock_gettime(CLOCK_MONOTONIC, &t2) ;
+   import_free_buffers() ;
+   if (ret < 0) {
+       return 1 ;
+   }
+
+   secs = (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec) / 1e9 ;
+   printf("nanofs_import: %d files, %lld bytes, %d blocks of %d bytes in %.3f s (%.1f MiB/s)\n",
+          num_files, total, dev_size, options.blockSize, secs, (secs > 0) ? total / secs / (1024*1024) : 0.0) ;
+
+   return 0 ;
+}
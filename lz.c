@@ -0,0 +1,263 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include "lz.h"
+
+#include <string.h>
+
+
+/*
+ *  es: Formato: secuencias [token][literales][desplazamiento][longitud]
+ *      token = (nº literales << 4) | (longitud coincidencia - LZ_MIN_MATCH),
+ *      cada campo de 4 bits con valor 15 continúa en bytes de 255.
+ *  en: Format: sequences [token][literals][offset][match length]
+ *      token = (literals << 4) | (match length - LZ_MIN_MATCH),
+ *      each 4-bit field equal to 15 goes on with 255-valued bytes.
+ */
+
+#define LZ_MIN_MATCH    4
+#define LZ_LAST_LITERALS 5
+#define LZ_MF_LIMIT     12
+#define LZ_MAX_OFFSET   65535
+#define LZ_HASH_LOG     12
+
+
+static inline uint32_t lz_read32 ( const uint8_t *p )
+{
+    uint32_t v ;
+
+    memcpy(&v, p, sizeof(uint32_t)) ;
+    return v ;
+}
+
+static inline uint32_t lz_hash ( uint32_t v )
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_LOG) ;
+}
+
+static int lz_put_length ( uint8_t **op, uint8_t *oend, int len )
+{
+    // es: escribir el resto de una longitud >= 15
+    // en: write the remainder of a length >= 15
+    while (len >= 255)
+    {
+         if (*op >= oend) {
+             return -1 ;
+         }
+         *(*op)++ = 255 ;
+         len -= 255 ;
+    }
+
+    if (*op >= oend) {
+        return -1 ;
+    }
+    *(*op)++ = (uint8_t)len ;
+
+    return 1 ;
+}
+
+static int lz_put_sequence ( uint8_t **op, uint8_t *oend,
+                             const uint8_t *lit, int lit_len,
+                             int offset, int match_len )
+{
+    uint8_t *token ;
+
+    // es: token
+    // en: token
+    if (*op >= oend) {
+        return -1 ;
+    }
+    token  = (*op)++ ;
+    *token = (uint8_t)((lit_len >= 15 ? 15 : lit_len) << 4) ;
+
+    // es: literales
+    // en: literals
+    if ( (lit_len >= 15) && (lz_put_length(op, oend, lit_len - 15) < 0) ) {
+        return -1 ;
+    }
+    if (*op + lit_len > oend) {
+        return -1 ;
+    }
+    memcpy(*op, lit, lit_len) ;
+    *op += lit_len ;
+
+    // es: la última secuencia no tiene coincidencia
+    // en: the last sequence has no match
+    if (0 == match_len) {
+        return 1 ;
+    }
+
+    // es: desplazamiento + longitud de la coincidencia
+    // en: offset + match length
+    if (*op + 2 > oend) {
+        return -1 ;
+    }
+    *(*op)++ = (uint8_t)(offset & 0xFF) ;
+    *(*op)++ = (uint8_t)(offset >> 8) ;
+
+    match_len -= LZ_MIN_MATCH ;
+    *token |= (uint8_t)(match_len >= 15 ? 15 : match_len) ;
+    if ( (match_len >= 15) && (lz_put_length(op, oend, match_len - 15) < 0) ) {
+        return -1 ;
+    }
+
+    return 1 ;
+}
+
+
+/*
+ *  es: Interfaz
+ *  en: Interface
+ */
+
+int lz_compress ( const void *src, int src_size, void *dst, int dst_size )
+{
+    const uint8_t *in     = src ;
+    const uint8_t *anchor = in ;
+    const uint8_t *ip     = in ;
+    const uint8_t *ilimit = in + src_size - LZ_MF_LIMIT ;
+    const uint8_t *mlimit = in + src_size - LZ_LAST_LITERALS ;
+    uint8_t       *op     = dst ;
+    uint8_t       *oend   = op + dst_size ;
+    int32_t        table[1 << LZ_HASH_LOG] ;
+
+    // es: tabla hash de posiciones de 4 bytes ya vistos
+    // en: hash table of already seen 4-byte positions
+    memset(table, 0xFF, sizeof(table)) ;
+
+    while ( (src_size > LZ_MF_LIMIT) && (ip < ilimit) )
+    {
+         uint32_t seq = lz_read32(ip) ;
+         uint32_t h   = lz_hash(seq) ;
+         int32_t  ref = table[h] ;
+
+         table[h] = (int32_t)(ip - in) ;
+
+         // es: ¿coincidencia válida?, si no avanzar (más rápido cuanto más tiempo sin coincidencias)
+         // en: valid match?, otherwise skip ahead (faster the longer there is no match)
+         if ( (ref < 0) || (ip - (in + ref) > LZ_MAX_OFFSET) || (lz_read32(in + ref) != seq) )
+         {
+             ip += 1 + ((ip - anchor) >> 6) ;
+             continue ;
+         }
+
+         // es: extender la coincidencia
+         // en: extend the match
+         const uint8_t *match = in + ref ;
+         int match_len = LZ_MIN_MATCH ;
+         while ( (ip + match_len < mlimit) && (ip[match_len] == match[match_len]) ) {
+              match_len++ ;
+         }
+
+         if (lz_put_sequence(&op, oend, anchor, (int)(ip - anchor), (int)(ip - match), match_len) < 0) {
+             return -1 ;
+         }
+
+         ip    += match_len ;
+         anchor = ip ;
+    }
+
+    // es: literales finales
+    // en: last literals
+    if (lz_put_sequence(&op, oend, anchor, (int)(in + src_size - anchor), 0, 0) < 0) {
+        return -1 ;
+    }
+
+    return (int)(op - (uint8_t *)dst) ;
+}
+
+int lz_decompress ( const void *src, int src_size, void *dst, int dst_size )
+{
+    const uint8_t *ip   = src ;
+    const uint8_t *iend = ip + src_size ;
+    uint8_t       *op   = dst ;
+    uint8_t       *oend = op + dst_size ;
+    int            len ;
+
+    while (ip < iend)
+    {
+         uint8_t token = *ip++ ;
+
+         // es: literales
+         // en: literals
+         len = token >> 4 ;
+         if (15 == len)
+         {
+             uint8_t s ;
+             do {
+                 if (ip >= iend) {
+                     return -1 ;
+                 }
+                 s    = *ip++ ;
+                 len += s ;
+             } while (255 == s) ;
+         }
+         if ( (ip + len > iend) || (op + len > oend) ) {
+             return -1 ;
+         }
+         memcpy(op, ip, len) ;
+         ip += len ;
+         op += len ;
+
+         // es: la última secuencia no tiene coincidencia
+         // en: the last sequence has no match
+         if (ip >= iend) {
+             break ;
+         }
+
+         // es: copiar la coincidencia (puede solaparse con el destino)
+         // en: copy the match (it may overlap the destination)
+         if (ip + 2 > iend) {
+             return -1 ;
+         }
+         int offset = ip[0] | (ip[1] << 8) ;
+         ip += 2 ;
+         if ( (0 == offset) || (offset > op - (uint8_t *)dst) ) {
+             return -1 ;
+         }
+
+         len = token & 0x0F ;
+         if (15 == len)
+         {
+             uint8_t s ;
+             do {
+                 if (ip >= iend) {
+                     return -1 ;
+                 }
+                 s    = *ip++ ;
+                 len += s ;
+             } while (255 == s) ;
+         }
+         len += LZ_MIN_MATCH ;
+         if (op + len > oend) {
+             return -1 ;
+         }
+
+         const uint8_t *match = op - offset ;
+         for (int i=0; i<len; i++) {
+              op[i] = match[i] ;
+         }
+         op += len ;
+    }
+
+    return (int)(op - (uint8_t *)dst) ;
+}
+
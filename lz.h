@@ -0,0 +1,42 @@
+
+/*
+ *  Copyright 2016-2020 Alejandro Calderon Mateos (ARCOS.INF.UC3M.ES)
+ *
+ *  This file is part of nanofs (nano-filesystem).
+ *
+ *  nanofs is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Lesser General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  nanofs is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public License
+ *  along with nanofs.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+#ifndef _LZ_H
+#define _LZ_H
+
+
+#include <stdlib.h>
+#include <stdint.h>
+
+
+/*
+ *  es: Compresor LZ77 rápido (formato de secuencias tipo LZ4)
+ *  en: Fast LZ77 compressor (LZ4-like sequence format)
+ *
+ *  es: devuelven el número de bytes generados, o -1 si no caben en dst_size
+ *  en: return the number of bytes produced, or -1 if they do not fit in dst_size
+ */
+
+int lz_compress   ( const void *src, int src_size, void *dst, int dst_size ) ;
+int lz_decompress ( const void *src, int src_size, void *dst, int dst_size ) ;
+
+
+#endif
+
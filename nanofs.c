@@ -20,6 +20,9 @@
  */
 
 
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 #include "nanofs.h"
 
 
@@ -31,9 +34,29 @@
 // es: Metadatos leídos desde disco
 // en: Metadata from disk
 TypeSuperblock  sblock ;
-TypeInodesDisk  inodes ;
+TypeInodesMem   inodes ;
+TypeNamesDisk   names ;
+uint32_t       *crc_map = NULL ; // es: sumas de control por bloque (solo con F_CHECKSUM)
+                                 // en: per-block checksums (only with F_CHECKSUM)
 TypeInodeMap    i_map ;
-TypeBlockMap    b_map ;
+TypeBlockMap   *b_map = NULL ;   // es: mapas de bloques de datos (numDataBlocks entradas)
+TypeClusterMap *c_map = NULL ;   // en: data block maps (numDataBlocks entries)
+TypeRefMap     *r_map = NULL ;
+TypeFingerprintMap *f_map = NULL ;
+uint32_t       *g_free = NULL ;  // es: bloques libres por grupo (se calcula al montar)
+                                 // en: free blocks per group (computed on mount)
+uint32_t       *g_inodes = NULL ; // es: i-nodos en uso por grupo (se calcula al montar)
+                                  // en: i-nodes in use per group (computed on mount)
+
+// es: índice en memoria de huellas -> bloque (F_DEDUP, tabla hash abierta)
+// en: in-memory fingerprint -> block index (F_DEDUP, open addressing hash table)
+struct {
+    uint64_t fingerprint ;
+     int32_t block_id ;     // es: -1: entrada vacía
+                            // en: -1: empty slot
+} *f_index = NULL ;         // es: 2*numDataBlocks entradas
+                            // en: 2*numDataBlocks entries
+int f_index_used = 0 ;
 
 // es: Metadatos extra de apoyo (que no van a disco)
 // en: Extra support metadata (not to be stored on disk)
@@ -42,11 +65,70 @@ struct {
                         // en: read/write seek position
     int8_t   is_open  ; // es: 0: falso, 1: verdadero
                         // en: 0: false, 1: true
+    char    *cache    ; // es: clúster en memoria (escritura diferida con F_COMPRESS o F_DEDUP)
+                        // en: in-memory cluster (write-back with F_COMPRESS or F_DEDUP)
+    int32_t  cache_cluster ; // es: clúster en cache (-1: ninguno)
+                             // en: cached cluster (-1: none)
+    int8_t   cache_dirty ;   // es: 0: limpio, 1: modificado
+                             // en: 0: clean, 1: dirty
+    int32_t  goal ;          // es: bloque de datos preferido para el siguiente (-1: ninguno)
+                             // en: preferred data block for the next one (-1: none)
 } inodes_x [NUM_INODES] ;
 
+char device_name[DEVICE_NAME_LENGTH+1] = DISK ; // es: dispositivo ("[backend:]path")
+                                                // en: device ("[backend:]path")
+
 int8_t is_mounted = 0 ; // es: 0: falso, 1: verdadero
                         // en: 0: false, 1: true
 
+int8_t is_readonly = 0 ; // es: 1: montada una instantánea (solo lectura)
+                         // en: 1: a snapshot is mounted (read-only)
+
+TypeStats stats ;       // es: estadísticas
+                        // en: statistics
+
+// es: petición asíncrona en curso, repartida en bloques (ids: los que se leen y los que se escriben)
+// en: asynchronous request in flight, split into blocks (ids: the ones read and the ones written)
+typedef struct async_state {
+    TypeFileRequest *request ;
+    int      offset, length ;
+    int      first_block, num_blocks ;
+    int      next_block ;   // es: siguiente bloque a empezar
+                            // en: next block to start
+    int      pending ;      // es: bloques empezados y sin terminar
+                            // en: blocks started and not finished
+    int      error ;
+    int     *read_ids ;     // es: BLOCK_NONE: nada que leer (hueco o bloque nuevo)
+    int     *write_ids ;    // en: BLOCK_NONE: nothing to read (hole or new block)
+    struct async_state *next ;
+    int      ids[] ;
+} TypeAsyncState ;
+
+// es: bloque en curso de una petición asíncrona
+// en: block in flight of an asynchronous request
+typedef struct {
+    TypeBlockRequest  breq ;
+    TypeAsyncState   *state ;   // es: NULL: libre
+                                // en: NULL: free
+    int               index ;   // es: bloque dentro de la petición
+                                // en: block within the request
+} TypeAsyncSlot ;
+
+// es: peticiones asíncronas (en curso -> bloques por baio -> completadas)
+// en: asynchronous requests (in flight -> blocks through baio -> completed)
+struct {
+    TypeAsyncState  *active, *active_last ;  // es: en orden de envío
+                                             // en: in submission order
+    TypeFileRequest *done,   *done_last ;
+    int        inflight ;   // es: enviadas y no recogidas
+                            // en: submitted and not reaped
+    int        event_fd ;   // es: -1: sin crear
+                            // en: -1: not created
+    char      *buffers ;    // es: ASYNC_SLOTS bloques alineados (NULL: sin reservar)
+                            // en: ASYNC_SLOTS aligned blocks (NULL: not allocated)
+    TypeAsyncSlot slots[ASYNC_SLOTS] ;
+} async = { NULL, NULL, NULL, NULL, 0, -1, NULL } ;
+
 
 /*
  * es: Funciones auxiliares
@@ -69,8 +151,12 @@ int debug_print_sizeof ( void )
    printf("Size of data structures:\n") ;
    printf(" * Size of Superblock: %ld bytes.\n", sizeof(TypeSuperblock)) ;
    printf(" * Size of InodeDisk:  %ld bytes.\n", sizeof(TypeInodeDisk)) ;
+   printf(" * Size of NameDisk:   %ld bytes.\n", sizeof(TypeNameDisk)) ;
    printf(" * Size of InodeMap:   %ld bytes.\n", sizeof(TypeInodeMap)) ;
-   printf(" * Size of BlockMap:   %ld bytes.\n", sizeof(TypeBlockMap)) ;
+   printf(" * Size of BlockMap:   %ld bytes.\n", sblock.numDataBlocks * sizeof(TypeBlockMap)) ;
+   printf(" * Size of ClusterMap: %ld bytes.\n", sblock.numDataBlocks * sizeof(TypeClusterMap)) ;
+   printf(" * Size of RefMap:     %ld bytes.\n", sblock.numDataBlocks * sizeof(TypeRefMap)) ;
+   printf(" * Size of FingerprintMap: %ld bytes.\n", sblock.numDataBlocks * sizeof(TypeFingerprintMap)) ;
 
    return 1 ;
 }
@@ -80,80 +166,422 @@ int debug_print_superblock ( void )
    printf("\n") ;
    printf("SuperBlock:\n") ;
    printf(" * numMagic:\t\t0x%x\n",      sblock.numMagic) ;
+   printf(" * version:\t\t%d\n",         sblock.version) ;
+   printf(" * blockSize:\t\t%d\n",       sblock.blockSize) ;
+   printf(" * features:\t\t0x%x\n",      sblock.features) ;
+   printf(" * clusterBlocks:\t%d\n",     sblock.clusterBlocks) ;
    printf(" * numInodes:\t\t%d\n",       sblock.numInodes) ;
    printf(" * numInodesBlocks:\t%d\n",   sblock.numInodesBlocks) ;
    printf(" * inodesPerBlock:\t%d\n",    sblock.inodesPerBlock) ;
+   printf(" * numNamesBlocks:\t%d\n",    sblock.numNamesBlocks) ;
+   printf(" * namesPerBlock:\t%d\n",     sblock.namesPerBlock) ;
    printf(" * numDataBlocks:\t%d\n",     sblock.numDataBlocks) ;
+   printf(" * numMapsBlocks:\t%d\n",     sblock.numMapsBlocks) ;
    printf(" * firstMapsBlock:\t%d\n",    sblock.firstMapsBlock) ;
    printf(" * firstInodeBlock:\t%d\n",   sblock.firstInodeBlock) ;
+   printf(" * firstNamesBlock:\t%d\n",   sblock.firstNamesBlock) ;
+   printf(" * numSnapshots:\t%d\n",      sblock.numSnapshots) ;
+   printf(" * snapshotMask:\t0x%x\n",    sblock.snapshotMask) ;
+   printf(" * firstSnapshotBlock:\t%d\n", sblock.firstSnapshotBlock) ;
+   printf(" * numCrcBlocks:\t%d\n",      sblock.numCrcBlocks) ;
+   printf(" * firstCrcBlock:\t%d\n",     sblock.firstCrcBlock) ;
    printf(" * firstDataBlock:\t%d\n",    sblock.firstDataBlock) ;
    printf(" * sizeDevice:\t\t%d\n",      sblock.sizeDevice) ;
+   printf(" * groupBlocks:\t\t%d\n",     sblock.groupBlocks) ;
+   printf(" * numGroups:\t\t%d\n",       sblock.numGroups) ;
 
    return 1 ;
 }
 
 
+/*
+ * es: Acceso a bloques (con suma de control opcional)
+ * en: Block access (with optional checksum)
+ */
+
+int nanofs_bread ( int block_id, void *buffer )
+{
+    int ret ;
+
+    ret = bread(device_name, block_id, buffer) ;
+    if (ret < 0) {
+        return ret ;
+    }
+    stats.blocksRead++ ;
+
+    // es: comprobar la suma de control del bloque leído
+    // en: check the checksum of the block read
+    if ( (NULL != crc_map) && (crc_map[block_id] != crc32c(0, buffer, sblock.blockSize)) ) {
+        stats.checksumErrors++ ;
+        return -1 ;
+    }
+
+    return ret ;
+}
+
+int nanofs_bwrite ( int block_id, void *buffer )
+{
+    // es: calcular la suma de control del bloque a escribir
+    // en: compute the checksum of the block to be written
+    if (NULL != crc_map) {
+        crc_map[block_id] = crc32c(0, buffer, sblock.blockSize) ;
+    }
+    stats.blocksWritten++ ;
+
+    return bwrite(device_name, block_id, buffer) ;
+}
+
+int nanofs_bio ( int is_write, int n, int *block_ids, char **buffers )
+{
+    TypeBlockRequest reqs[BAIO_QUEUE_DEPTH] ;
+    int ret = 1 ;
+
+    // es: un solo bloque -> síncrono
+    // en: a single block -> synchronous
+    if (1 == n) {
+        return is_write ? nanofs_bwrite(block_ids[0], buffers[0]) : nanofs_bread(block_ids[0], buffers[0]) ;
+    }
+
+    // es: hasta BAIO_QUEUE_DEPTH peticiones en curso (ventana deslizante)
+    // en: up to BAIO_QUEUE_DEPTH requests in flight (sliding window)
+    for (int i=0; i<n+BAIO_QUEUE_DEPTH; i++)
+    {
+         TypeBlockRequest *req = &(reqs[i % BAIO_QUEUE_DEPTH]) ;
+
+         // es: recoger la petición que ocupaba este hueco
+         // en: reap the request that was using this slot
+         if (i >= BAIO_QUEUE_DEPTH)
+         {
+             int j = i - BAIO_QUEUE_DEPTH ;
+             if (baio_wait(req) < 0) {
+                 ret = -1 ;
+             }
+             else if (is_write) {
+                 stats.blocksWritten++ ;
+             }
+             else {
+                 stats.blocksRead++ ;
+                 if ( (NULL != crc_map) && (crc_map[block_ids[j]] != crc32c(0, buffers[j], sblock.blockSize)) ) {
+                     stats.checksumErrors++ ;
+                     ret = -1 ;
+                 }
+             }
+         }
+         if (i >= n) {
+             continue ;
+         }
+
+         // es: enviar la siguiente (la suma de control se calcula antes de escribir)
+         // en: submit the next one (the checksum is computed before writing)
+         if ( (is_write) && (NULL != crc_map) ) {
+             crc_map[block_ids[i]] = crc32c(0, buffers[i], sblock.blockSize) ;
+         }
+         req->devname   = device_name ;
+         req->bid       = block_ids[i] ;
+         req->buffer    = buffers[i] ;
+         req->is_write  = is_write ;
+         req->callback  = NULL ;
+         req->user_data = NULL ;
+         while (baio_submit(req) < 0)
+         {
+             // es: cola llena (otros usuarios) -> esperar a cualquiera
+             // en: full queue (other users) -> wait for any request
+             if (baio_wait(NULL) < 0) {
+                 req->result = -1 ;
+                 req->done   = 1 ;
+                 break ;
+             }
+         }
+    }
+
+    return ret ;
+}
+
+int nanofs_bio_range ( int is_write, int first_id, int n, char *buffer, int stride )
+{
+    int   ids[BAIO_QUEUE_DEPTH] ;
+    char *bufs[BAIO_QUEUE_DEPTH] ;
+    int   ret = 1 ;
+
+    // es: buffer contiguo -> una sola petición de n bloques (el backend puede repartirla)
+    // en: contiguous buffer -> a single request of n blocks (the backend may split it)
+    if ( (stride == sblock.blockSize) && (n > 0) )
+    {
+        for (int i=0; (is_write) && (NULL != crc_map) && (i<n); i++) {
+             crc_map[first_id + i] = crc32c(0, buffer + (size_t)i * stride, sblock.blockSize) ;
+        }
+        ret = is_write ? bwriten(device_name, first_id, n, buffer) : breadn(device_name, first_id, n, buffer) ;
+        if (ret < 0) {
+            return -1 ;
+        }
+        if (is_write) {
+            stats.blocksWritten += n ;
+            return 1 ;
+        }
+        stats.blocksRead += n ;
+        for (int i=0; (NULL != crc_map) && (i<n); i++)
+        {
+             if (crc_map[first_id + i] != crc32c(0, buffer + (size_t)i * stride, sblock.blockSize)) {
+                 stats.checksumErrors++ ;
+                 ret = -1 ;
+             }
+        }
+        return ret ;
+    }
+
+    // es: n bloques consecutivos desde first_id (stride 0: el mismo buffer para todos)
+    // en: n consecutive blocks from first_id (stride 0: the same buffer for all of them)
+    for (int i=0; i<n; i+=BAIO_QUEUE_DEPTH)
+    {
+         int m = min_value(BAIO_QUEUE_DEPTH, n - i) ;
+         for (int j=0; j<m; j++) {
+              ids[j]  = first_id + i + j ;
+              bufs[j] = buffer + (size_t)(i + j) * stride ;
+         }
+         if (nanofs_bio(is_write, m, ids, bufs) < 0) {
+             ret = -1 ;
+         }
+    }
+
+    return ret ;
+}
+
+
 /*
  * es: Funciones secundarias
  * en: Secondary functions
  */
 
+uint32_t nanofs_namehash ( char *fname )
+{
+    uint32_t h = 2166136261u ;
+
+    // es: FNV-1a del nombre (0 queda reservado para entradas libres)
+    // en: FNV-1a of the name (0 is reserved for free entries)
+    while (*fname != '\0') {
+        h = (h ^ (uint8_t)(*fname)) * 16777619u ;
+        fname++ ;
+    }
+
+    return (0 == h) ? 1 : h ;
+}
+
+int nanofs_iclear ( int inodo_id )
+{
+    // es: valores por defecto en el i-nodo y en su nombre
+    // en: set default values for the inode and its name
+    inodes.size[inodo_id]          = 0 ;
+    inodes.type[inodo_id]          = 0 ;
+    inodes.nameHash[inodo_id]      = 0 ;
+    inodes.directBlock[inodo_id]   = BLOCK_NONE ;
+    inodes.indirectBlock[inodo_id] = BLOCK_NONE ;
+    memset(&(names[inodo_id]), 0, sizeof(TypeNameDisk)) ;
+    inodes_x[inodo_id].goal        = -1 ;
+
+    return 1 ;
+}
+
+int nanofs_iname ( int inodo_id, char *name, uint32_t hash )
+{
+    // es: nombre de un fichero nuevo
+    // en: name of a new file
+    strcpy(names[inodo_id].name, name) ;
+    names[inodo_id].hash      = hash ;
+    inodes.nameHash[inodo_id] = hash ;
+    inodes.type[inodo_id]     = T_FILE ;
+
+    return 1 ;
+}
+
+int nanofs_igroup ( int inodo_id )
+{
+    // es: cada grupo tiene su parte de los i-nodos
+    // en: each group has its share of the i-nodes
+    return (int)((long)inodo_id * sblock.numGroups / sblock.numInodes) ;
+}
+
 int nanofs_ialloc ( void )
 {
-    int i;
+    int i, g, b, best = -1 ;
 
-    // es: buscar un i-nodo libre
-    // en: search for a free i-node
+    // es: buscar un i-nodo libre en el grupo con más bloques libres (y menos i-nodos en uso),
+    //     para que los ficheros nuevos no compartan grupo mientras haya otros vacíos
+    // en: search for a free i-node in the group with more free blocks (and fewer i-nodes in use),
+    //     so that new files do not share a group while there are other empty ones
     for (i=0; i<sblock.numInodes; i++)
     {
-          if (i_map[i] == 0)
-          {
-              // es: inodo ocupado ahora
-              // en: set inode to used
-              i_map[i] = 1 ;
+          if (i_map[i] != 0) {
+              continue ;
+          }
+          g = nanofs_igroup(i) ;
+          b = (-1 == best) ? 0 : nanofs_igroup(best) ;
+          if ( (-1 == best) || (g_free[g] > g_free[b]) ||
+               ( (g_free[g] == g_free[b]) && (g_inodes[g] < g_inodes[b]) ) ) {
+              best = i ;
+          }
+    }
+    if (-1 == best) {
+        return -1 ;
+    }
 
-              // es: valores por defecto en el i-nodo
-              // en: set default values for the inode
-              memset(&(inodes[i]), 0, sizeof(TypeInodeDisk)) ;
+    // es: inodo ocupado ahora
+    // en: set inode to used
+    i_map[best] = 1 ;
+    g_inodes[nanofs_igroup(best)]++ ;
 
-              // es: devolver identificador de i-nodo
-              // en: return the inode id.
-              return i ;
-          }
+    // es: valores por defecto en el i-nodo
+    // en: set default values for the inode
+    nanofs_iclear(best) ;
+
+    // es: devolver identificador de i-nodo
+    // en: return the inode id.
+    return best ;
+}
+
+int nanofs_bmapn ( int inodo_id, int logic_block, int n, int *block_ids )
+{
+    int *b ;
+    int ret ;
+
+    // es: comprobar validez de inodo_id y del rango de bloques lógicos
+    // en: check inode id. and the range of logical blocks
+    if ( (inodo_id < 0) || (inodo_id >= sblock.numInodes) ) {
+        return -1;
+    }
+    if ( (logic_block < 0) || (n < 1) || (logic_block + n - 1 > (sblock.blockSize/4)) ) {
+        return -1 ;
     }
 
-    return -1;
+    // es: referencia a bloque directo
+    // en: direct block
+    if (0 == logic_block)
+    {
+        block_ids[0] = inodes.directBlock[inodo_id] ;
+        block_ids++ ;
+        logic_block++ ;
+        n-- ;
+    }
+    if (0 == n) {
+        return 1 ;
+    }
+
+    // es: referencias dentro de bloque indirecto (se lee una sola vez para todas)
+    // en: entries within the indirect block (read only once for all of them)
+    if (BLOCK_NONE == inodes.indirectBlock[inodo_id])
+    {
+        for (int i=0; i<n; i++) {
+             block_ids[i] = BLOCK_NONE ;
+        }
+        return 1 ;
+    }
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+    ret = nanofs_bread(sblock.firstDataBlock + inodes.indirectBlock[inodo_id], b) ;
+    for (int i=0; (ret >= 0) && (i<n); i++) {
+         block_ids[i] = b[logic_block - 1 + i] ;
+    }
+    bpool_put(b) ;
+
+    return (ret < 0) ? -1 : 1 ;
 }
 
-int nanofs_alloc ( void )
+int nanofs_bmap ( int inodo_id, int offset )
 {
-    char b[BLOCK_SIZE];
-    int i;
+    int block_id ;
 
-    // es: buscar un bloque de datos libre
-    // en: search for a free data block
-    for (i=0; i<sblock.numDataBlocks; i++)
+    // es: bloque lógico de datos asociado
+    // en: logical block
+    if (nanofs_bmapn(inodo_id, offset / sblock.blockSize, 1, &block_id) < 0) {
+        return -1 ;
+    }
+
+    return block_id ;
+}
+
+int nanofs_goal ( int inodo_id )
+{
+    int last ;
+
+    // es: tras el último bloque que se le ha dado al fichero
+    // en: after the last block given to the file
+    if (inodes_x[inodo_id].goal >= 0) {
+        return inodes_x[inodo_id].goal ;
+    }
+
+    // es: tras su último bloque en disco (p.ej. al seguir escribiendo después de montar)
+    // en: after its last block on disk (e.g. when writing again after mount)
+    if (inodes.size[inodo_id] > 0)
+    {
+        last = nanofs_bmap(inodo_id, inodes.size[inodo_id] - 1) ;
+        if (last >= 0) {
+            return last + 1 ;
+        }
+    }
+
+    // es: el principio de los bloques del grupo del i-nodo
+    // en: the beginning of the blocks of the i-node group
+    return nanofs_igroup(inodo_id) * sblock.groupBlocks ;
+}
+
+int nanofs_alloc_nozero ( int inodo_id )
+{
+    int goal, g0, g, first, last ;
+
+    // es: buscar un bloque de datos libre desde el objetivo del fichero hasta el final de su
+    //     grupo, luego en los grupos siguientes (saltando los llenos) y por último el principio
+    //     del primer grupo
+    // en: search for a free data block from the file goal to the end of its group, then in
+    //     the following groups (skipping the full ones) and finally the beginning of the first group
+    goal = nanofs_goal(inodo_id) ;
+    if (goal >= sblock.numDataBlocks) {
+        goal = 0 ;
+    }
+    g0 = goal / sblock.groupBlocks ;
+    for (int k=0; k<=sblock.numGroups; k++)
     {
-          if (b_map[i] == 0)
+          g = (g0 + k) % sblock.numGroups ;
+          if (0 == g_free[g]) {
+              continue ;
+          }
+          first = (0 == k) ? goal : g * sblock.groupBlocks ;
+          last  = min_value((g + 1) * sblock.groupBlocks, sblock.numDataBlocks) ;
+          for (int i=first; i<last; i++)
           {
-              // es: bloque ocupado ahora
-              // en: data block used now
-              b_map[i] = 1 ;
-
-              // es: valores por defecto en el bloque
-              // en: default values for the block
-              memset(b, 0, BLOCK_SIZE) ;
-              bwrite(DISK, sblock.firstDataBlock + i, b) ;
-
-              // es: devolver identificador del bloque
-              // en: return the block id.
-              return i ;
+                if (b_map[i] == 0)
+                {
+                    // es: bloque ocupado ahora (con una referencia y sin huella)
+                    // en: data block used now (with one reference and no fingerprint)
+                    b_map[i] = 1 ;
+                    r_map[i] = 1 ;
+                    f_map[i] = 0 ;
+                    g_free[g]-- ;
+                    inodes_x[inodo_id].goal = i + 1 ;
+
+                    // es: devolver identificador del bloque
+                    // en: return the block id.
+                    return i ;
+                }
           }
     }
 
     return -1;
 }
 
+int nanofs_free_count ( void )
+{
+    int n = 0 ;
+
+    // es: sumar los bloques libres de los grupos
+    // en: add up the free blocks of the groups
+    for (int g=0; g<sblock.numGroups; g++) {
+         n += g_free[g] ;
+    }
+
+    return n ;
+}
+
 int nanofs_ifree ( int inodo_id )
 {
     // es: comprobar validez de inodo_id
@@ -164,6 +592,9 @@ int nanofs_ifree ( int inodo_id )
 
     // es: liberar i-nodo
     // en: free i-node
+    if (i_map[inodo_id] != 0) {
+        g_inodes[nanofs_igroup(inodo_id)]-- ;
+    }
     i_map[inodo_id] = 0;
 
     return -1;
@@ -173,26 +604,72 @@ int nanofs_free ( int block_id )
 {
     // es: comprobar validez de block_id
     // en: check block id.
-    if (block_id > sblock.numDataBlocks) {
+    if ( (block_id < 0) || (block_id >= sblock.numDataBlocks) ) {
         return -1;
     }
 
-    // es: liberar bloque
-    // en: free block
+    // es: si está compartido solo se quita una referencia
+    // en: if shared, only one reference is dropped
+    if (r_map[block_id] > 1) {
+        r_map[block_id]-- ;
+        return 1 ;
+    }
+
+    // es: liberar bloque (la huella se mantiene hasta que se reutilice el bloque)
+    // en: free block (the fingerprint is kept until the block is reused)
     b_map[block_id] = 0;
+    c_map[block_id] = 0;
+    r_map[block_id] = 0;
+    g_free[block_id / sblock.groupBlocks]++ ;
 
     return -1;
 }
 
+int nanofs_alloc ( int inodo_id )
+{
+    char *b ;
+    int i;
+
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+
+    // es: buscar un bloque de datos libre
+    // en: search for a free data block
+    i = nanofs_alloc_nozero(inodo_id) ;
+    if (i < 0) {
+        bpool_put(b) ;
+        return -1 ;
+    }
+
+    // es: valores por defecto en el bloque
+    // en: default values for the block
+    memset(b, 0, sblock.blockSize) ;
+    if (nanofs_bwrite(sblock.firstDataBlock + i, b) < 0) {
+        nanofs_free(i) ;
+        bpool_put(b) ;
+        return -1 ;
+    }
+    bpool_put(b) ;
+
+    return i ;
+}
+
 int nanofs_namei ( char *fname )
 {
+   uint32_t h ;
    int i;
 
-   // es: buscar i-nodo con name <fname>
-   // en: search an i-node with name <fname>
+   // es: buscar i-nodo con name <fname> (primero por hash, luego por nombre)
+   // en: search an i-node with name <fname> (hash first, then the name)
+   h = nanofs_namehash(fname) ;
    for (i=0; i<sblock.numInodes; i++)
    {
-         if (! strcmp(inodes[i].name, fname)) {
+         if (inodes.nameHash[i] != h) {
+             continue ;
+         }
+         if (! strcmp(names[i].name, fname)) {
                return i;
          }
    }
@@ -200,321 +677,683 @@ int nanofs_namei ( char *fname )
    return -1;
 }
 
-int nanofs_bmap ( int inodo_id, int offset )
+int nanofs_bmap_setn ( int inodo_id, int logic_block, int n, int *block_ids )
 {
-    int b[BLOCK_SIZE/4] ;
-    int logic_block ;
+    int *b ;
+    int  old_id, indirect_id, first, count ;
 
-    // es: comprobar validez de inodo_id
-    // en: check inode id.
-    if (inodo_id > sblock.numInodes) {
-        return -1;
+    // es: comprobar validez del rango de bloques lógicos
+    // en: check the range of logical blocks
+    if ( (logic_block < 0) || (n < 1) || (logic_block + n - 1 > (sblock.blockSize/4)) ) {
+        return -1 ;
     }
 
-    // es: bloque lógico de datos asociado
-    // en: logical block
-    logic_block = offset / BLOCK_SIZE ;
-    if (logic_block > (BLOCK_SIZE/4)) {
+    // es: sólo el bloque directo
+    // en: only the direct block
+    if ( (0 == logic_block) && (1 == n) ) {
+        inodes.directBlock[inodo_id] = block_ids[0] ;
+        return 1 ;
+    }
+
+    // es: entradas del bloque indirecto (el bloque directo se enlaza al final)
+    // en: entries of the indirect block (the direct block is linked at the end)
+    first = (0 == logic_block) ? 1 : 0 ;
+    count = n - first ;
+
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+
+    // es: reservar el bloque indirecto la primera vez (todas las entradas a BLOCK_NONE)
+    //     o copiarlo si está compartido, sin tocar aún el i-nodo
+    // en: allocate the indirect block the first time (all entries set to BLOCK_NONE)
+    //     or copy it when shared, without touching the i-node yet
+    old_id      = inodes.indirectBlock[inodo_id] ;
+    indirect_id = old_id ;
+    if (BLOCK_NONE == old_id)
+    {
+        indirect_id = nanofs_alloc_nozero(inodo_id) ;
+        if (indirect_id < 0) {
+            bpool_put(b) ;
+            return -1 ;
+        }
+        for (int i=0; i<sblock.blockSize/4; i++) {
+             b[i] = BLOCK_NONE ;
+        }
+    }
+    else if (nanofs_bread(sblock.firstDataBlock + old_id, b) < 0) {
+        bpool_put(b) ;
+        return -1 ;
+    }
+    else if (r_map[old_id] > 1)
+    {
+        // es: copia en escritura del bloque indirecto compartido
+        // en: copy-on-write of the shared indirect block
+        indirect_id = nanofs_alloc_nozero(inodo_id) ;
+        if (indirect_id < 0) {
+            bpool_put(b) ;
+            return -1 ;
+        }
+    }
+
+    // es: actualizar las referencias dentro del bloque indirecto (se escribe una sola vez)
+    // en: update the entries within the indirect block (written only once)
+    for (int i=0; i<count; i++) {
+         b[logic_block + first - 1 + i] = block_ids[first + i] ;
+    }
+    if (nanofs_bwrite(sblock.firstDataBlock + indirect_id, b) < 0)
+    {
+        // es: deshacer la reserva, el i-nodo queda como estaba
+        // en: undo the allocation, the i-node is left untouched
+        if (indirect_id != old_id) {
+            nanofs_free(indirect_id) ;
+        }
+        bpool_put(b) ;
         return -1 ;
     }
+    bpool_put(b) ;
 
-    // es: devolver referencia a bloque directo 
-    // en: return direct block
-    if (0 == logic_block) {
-        return inodes[inodo_id].directBlock[0] ;
+    // es: enlazar el bloque indirecto y después el directo
+    // en: link the indirect block and then the direct one
+    if ( (indirect_id != old_id) && (BLOCK_NONE != old_id) ) {
+        nanofs_free(old_id) ;
+        stats.blocksCopiedOnWrite++ ;
+    }
+    inodes.indirectBlock[inodo_id] = indirect_id ;
+    if (1 == first) {
+        inodes.directBlock[inodo_id] = block_ids[0] ;
     }
 
-    // es: devolver referencia dentro de bloque indirecto
-    // en: return indirect block
-    bread(DISK, sblock.firstDataBlock + inodes[inodo_id].indirectBlock, b) ;
-    return b[logic_block - 1] ;
+    return 1 ;
 }
 
+int nanofs_bmap_set ( int inodo_id, int logic_block, int block_id )
+{
+    return nanofs_bmap_setn(inodo_id, logic_block, 1, &block_id) ;
+}
 
 /*
- * es: Funciones auxiliares para mkfs, mount y umount
- * en: Auxiliar functions for mkfs, mount, and umount
+ * es: Cada árbol de bloques (i-nodo vivo, clon o instantánea) cuenta como
+ *     una referencia a cada bloque que alcanza, incluido un indirecto compartido.
+ * en: Each block tree (live i-node, clone or snapshot) counts as one
+ *     reference to every block it reaches, including a shared indirect block.
  */
 
-int nanofs_meta_readFromDisk ( void )
+int nanofs_tree_retain ( int direct_id, int indirect_id )
 {
-    char b[BLOCK_SIZE] ;
+    int *b ;
 
-    // es: leer bloque 0 de disco en sblock
-    // en: read block 0 from disk to sbloques[0]
-    bread(DISK, 0, b) ;
-    memmove(&(sblock), b, sizeof(TypeSuperblock)) ;
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
 
-    // es: leer los bloques para el mapa de i-nodos y mapa de bloques de datos
-    // en: read the blocks where the i-node map and block map is stored
-    bread(DISK, sblock.firstMapsBlock, b) ;
-    memmove(&(i_map), b,                      sizeof(TypeInodeMap)) ;
-    memmove(&(b_map), b+sizeof(TypeInodeMap), sizeof(TypeBlockMap)) ;
+    // es: leer antes el indirecto para no dejar referencias a medias si falla
+    // en: read the indirect block first so that no half-taken references remain on failure
+    if ( (indirect_id >= 0) && (nanofs_bread(sblock.firstDataBlock + indirect_id, b) < 0) ) {
+        bpool_put(b) ;
+        return -1 ;
+    }
 
-    // es: leer los i-nodos a memoria
-    // en: read i-nodes to memory
-    int inodesLeftToRead = sblock.numInodes ;
-    for (int blocksRead=0; (inodesLeftToRead > 0); blocksRead++)
+    // es: añadir una referencia a cada bloque del árbol
+    // en: add one reference to every block of the tree
+    if (direct_id >= 0) {
+        r_map[direct_id]++ ;
+    }
+    if (indirect_id >= 0)
     {
-         int inodesRead   = blocksRead*sblock.inodesPerBlock ;
-         int inodesToPack = min_value(inodesLeftToRead, sblock.inodesPerBlock) ;
+        for (int i=0; i<sblock.blockSize/4; i++) {
+             if (b[i] >= 0) {
+                 r_map[b[i]]++ ;
+             }
+        }
+        r_map[indirect_id]++ ;
+    }
+    bpool_put(b) ;
 
-         bread(DISK, sblock.firstInodeBlock+blocksRead, b) ;
-         memmove(&(inodes[inodesRead]), b, inodesToPack*sizeof(TypeInodeDisk)) ;
+    return 1 ;
+}
 
-         inodesLeftToRead -= inodesToPack ;
+int nanofs_tree_release ( int direct_id, int indirect_id )
+{
+    int *b ;
+
+    // es: liberar bloque directo
+    // en: free direct block
+    if (direct_id >= 0) {
+        nanofs_free(direct_id) ;
     }
 
-    debug_print_sizeof() ;
-    debug_print_superblock() ;
+    // es: liberar los bloques referenciados desde el indirecto y el propio indirecto
+    // en: free the blocks referenced from the indirect block and the indirect block itself
+    if (indirect_id >= 0)
+    {
+        b = bpool_get(sblock.blockSize) ;
+        if ( (NULL != b) && (nanofs_bread(sblock.firstDataBlock + indirect_id, b) >= 0) )
+        {
+            for (int i=0; i<sblock.blockSize/4; i++) {
+                 if (b[i] >= 0) {
+                     nanofs_free(b[i]) ;
+                 }
+            }
+        }
+        bpool_put(b) ;
+        nanofs_free(indirect_id) ;
+    }
 
-    return 1;
+    return 1 ;
 }
 
-int nanofs_meta_writeToDisk ( void )
+int nanofs_ifreeblocks ( int inodo_id )
 {
-    char b[BLOCK_SIZE] ;
+    // es: soltar el árbol de bloques del i-nodo
+    // en: release the i-node block tree
+    nanofs_tree_release(inodes.directBlock[inodo_id], inodes.indirectBlock[inodo_id]) ;
+    inodes.directBlock[inodo_id]   = BLOCK_NONE ;
+    inodes.indirectBlock[inodo_id] = BLOCK_NONE ;
 
-    // es: escribir bloque 0 de sblock a disco
-    // en: write block 0 to disk from sbloques[0]
-     memset(b, 0, BLOCK_SIZE) ;
-    memmove(b, &(sblock), sizeof(TypeSuperblock)) ;
-    bwrite(DISK, 0, b) ;
+    return 1 ;
+}
 
-    // es: escribir los bloques para el mapa de i-nodos y el mapa de bloques de datos
-    // en: write the blocks where the i-node map and block map is stored
-     memset(b, 0, BLOCK_SIZE) ;
-    memmove(b,                        &(i_map), sizeof(TypeInodeMap)) ;
-    memmove(b + sizeof(TypeInodeMap), &(b_map), sizeof(TypeBlockMap)) ;
-    bwrite(DISK, sblock.firstMapsBlock, b) ;
+int nanofs_iremove ( int inodo_id )
+{
+    // es: descartar la cache (si estaba abierto) y liberar sus bloques y el i-nodo
+    // en: discard the cache (if it was open) and free its blocks and the i-node
+    bpool_put(inodes_x[inodo_id].cache) ;
+    inodes_x[inodo_id].cache = NULL ;
+    nanofs_ifreeblocks(inodo_id) ;
+    nanofs_iclear(inodo_id) ;
+    nanofs_ifree(inodo_id) ;
 
-    // es: escribir los i-nodos a disco
-    // en: write i-nodes to disk
-    int inodesLeftToWrite = sblock.numInodes ;
-    for (int blocksWritten=0; (inodesLeftToWrite > 0); blocksWritten++)
-    {
-         int inodesWritten = blocksWritten*sblock.inodesPerBlock ;
-         int inodesToPack  = min_value(inodesLeftToWrite, sblock.inodesPerBlock) ;
+    return 1 ;
+}
 
-          memset(b, 0, BLOCK_SIZE) ;
-         memmove(b, &(inodes[inodesWritten]), inodesToPack*sizeof(TypeInodeDisk)) ;
-         bwrite(DISK, sblock.firstInodeBlock+blocksWritten, b) ;
+int nanofs_maxsize ( void )
+{
+    // es: 1 bloque directo + blockSize/4 bloques desde el indirecto
+    // en: 1 direct block + blockSize/4 blocks from the indirect one
+    return (1 + sblock.blockSize/4) * sblock.blockSize ;
+}
 
-         inodesLeftToWrite -= inodesToPack ;
-    }
 
-    debug_print_sizeof() ;
-    debug_print_superblock() ;
+/*
+ * es: Funciones para deduplicación (F_DEDUP)
+ * en: Deduplication functions (F_DEDUP)
+ *
+ * es: f_map[x] != 0 implica que el contenido en disco del bloque x tiene esa
+ *     huella, aunque x esté libre: así un bloque liberado con el mismo
+ *     contenido puede recuperarse sin volver a escribirlo.
+ * en: f_map[x] != 0 implies the on-disk contents of block x have that
+ *     fingerprint, even if x is free: this way a freed block with the same
+ *     contents can be brought back without writing it again.
+ */
 
-    return 1 ;
+static inline uint64_t nanofs_rotl64 ( uint64_t x, int r )
+{
+    return (x << r) | (x >> (64 - r)) ;
 }
 
-int nanofs_meta_setDefault ( int dev_size )
+uint64_t nanofs_fingerprint ( char *buffer )
 {
-    // es: inicializar a los valores por defecto del superbloque, mapas e i-nodos
-    // en: set the default values of the superblock, inode map, etc.
-    sblock.numMagic          = 0x12345 ; // ayuda a comprobar que se haya creado por nuestro mkfs
-    sblock.numInodes         = NUM_INODES ;
-    sblock.numInodesBlocks   = (NUM_INODES * sizeof(TypeInodeDisk) + BLOCK_SIZE - 1) / BLOCK_SIZE ;
-    sblock.inodesPerBlock    = BLOCK_SIZE / sizeof(TypeInodeDisk) ;
-    sblock.numDataBlocks     = NUM_DATA_BLOCKS ;
-    sblock.firstMapsBlock    = 1 ;
-    sblock.firstInodeBlock   = 2 ;
-    sblock.firstDataBlock    = 1 + 1 + sblock.numInodesBlocks ; // 1:sb + 1:maps + 3:inodes
-    sblock.sizeDevice        = dev_size ;
-
-    for (int i=0; i<sblock.numInodes; i++) {
-         i_map[i] = 0; // free
-    }
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ sblock.blockSize ;
+    uint64_t v ;
 
-    for (int i=0; i<sblock.numDataBlocks; i++) {
-         b_map[i] = 0; // free
+    // es: mezcla de 8 en 8 bytes (estilo murmur3)
+    // en: mix 8 bytes at a time (murmur3 style)
+    for (int i=0; i<sblock.blockSize; i+=8)
+    {
+         memcpy(&v, buffer + i, sizeof(uint64_t)) ;
+         v *= 0x87C37B91114253D5ull ;
+         v  = nanofs_rotl64(v, 31) ;
+         v *= 0x4CF5AD432745937Full ;
+         h ^= v ;
+         h  = nanofs_rotl64(h, 27) * 5 + 0x52DCE729 ;
     }
 
-    for (int i=0; i<sblock.numInodes; i++) {
-         memset(&(inodes[i]), 0, sizeof(TypeInodeDisk) ) ;
-    }
+    h ^= h >> 33 ;
+    h *= 0xFF51AFD7ED558CCDull ;
+    h ^= h >> 33 ;
+    h *= 0xC4CEB9FE1A85EC53ull ;
+    h ^= h >> 33 ;
 
-    return 1;
+    return (0 == h) ? 1 : h ;
 }
 
-int nanofs_mount ( void )
+int nanofs_dedup_rebuild ( void )
 {
-    if (1 == is_mounted) {
-        return -1 ;
+    int n = 2 * sblock.numDataBlocks ;
+
+    // es: vaciar el índice y volver a insertar las huellas de f_map
+    // en: empty the index and insert the fingerprints in f_map again
+    for (int i=0; i<n; i++) {
+         f_index[i].block_id = -1 ;
     }
+    f_index_used = 0 ;
 
-    // es: leer los metadatos del sistema de ficheros de disco a memoria
-    // en: read the metadata file system from disk
-    nanofs_meta_readFromDisk() ;
+    for (int i=0; i<sblock.numDataBlocks; i++)
+    {
+         if (0 == f_map[i]) {
+             continue ;
+         }
 
-    // es: comprueba el número mágico
-    // en: check magic number
-    if (0x12345 != sblock.numMagic) {
-        return -1 ;
+         int slot = f_map[i] % n ;
+         while (-1 != f_index[slot].block_id) {
+              slot = (slot + 1) % n ;
+         }
+         f_index[slot].fingerprint = f_map[i] ;
+         f_index[slot].block_id    = i ;
+         f_index_used++ ;
     }
 
-    // es: montar
-    // en: mounted
-    is_mounted = 1 ; // 0: falso, 1: verdadero
-
     return 1 ;
 }
 
-int nanofs_umount ( void )
+int nanofs_dedup_insert ( int block_id, uint64_t fingerprint )
 {
-    // es: si NO mountado -> error
-    // en: if NOT mounted -> error
-    if (0 == is_mounted) {
-        return -1 ;
-    }
+    int n = 2 * sblock.numDataBlocks ;
+    int slot ;
 
-    // es: si algún fichero está abierto -> error
-    // en: if any file is open -> error
-    for (int i=0; i<sblock.numInodes; i++) {
-    if (1 == inodes_x[i].is_open)
-        return -1 ;
+    // es: guardar la huella del bloque
+    // en: keep the block fingerprint
+    f_map[block_id] = fingerprint ;
+
+    // es: reconstruir el índice si está demasiado lleno de entradas obsoletas
+    // en: rebuild the index if it is too full of stale entries
+    if (4 * (f_index_used + 1) > 3 * n) {
+        nanofs_dedup_rebuild() ;
     }
 
-    // es: escribir los metadatos del sistema de ficheros de memoria a disco
-    // en: write the metadata file system into disk
-    nanofs_meta_writeToDisk() ;
+    // es: sondeo lineal; se reutilizan huecos vacíos u obsoletos
+    // en: linear probing; empty or stale slots are reused
+    slot = fingerprint % n ;
+    while (-1 != f_index[slot].block_id)
+    {
+         int b = f_index[slot].block_id ;
+         if (f_map[b] != f_index[slot].fingerprint) {
+             break ;
+         }
+         if (b == block_id) {
+             return 1 ;
+         }
+         slot = (slot + 1) % n ;
+    }
 
-    // es: desmontar
-    // en: unmounted
-    is_mounted = 0 ; // 0: falso, 1: verdadero
+    if (-1 == f_index[slot].block_id) {
+        f_index_used++ ;
+    }
+    f_index[slot].fingerprint = fingerprint ;
+    f_index[slot].block_id    = block_id ;
 
     return 1 ;
 }
 
-int nanofs_mkfs ( int dev_size )
+int nanofs_dedup_lookup ( char *buffer, uint64_t fingerprint )
 {
-    char b[BLOCK_SIZE];
+    char *b ;
+    int   n = 2 * sblock.numDataBlocks ;
+    int   slot, block_id ;
 
-    // es: establecer los valores por defecto en memoria
-    // en: set default values in memory
-    nanofs_meta_setDefault(dev_size) ;
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+
+    for (slot = fingerprint % n; -1 != f_index[slot].block_id; slot = (slot + 1) % n)
+    {
+         block_id = f_index[slot].block_id ;
 
-    // es: escribir el sistema de ficheros inicial a disco
-    // en: write the default file system into disk
-    nanofs_meta_writeToDisk() ;
+         // es: descartar entradas obsoletas y huellas distintas
+         // en: skip stale entries and different fingerprints
+         if ( (f_index[slot].fingerprint != fingerprint) || (f_map[block_id] != fingerprint) ) {
+             continue ;
+         }
+
+         // es: comparar el contenido (la huella solo es una pista)
+         // en: compare contents (the fingerprint is only a hint)
+         if (nanofs_bread(sblock.firstDataBlock + block_id, b) < 0) {
+             continue ;
+         }
+         if (memcmp(b, buffer, sblock.blockSize)) {
+             continue ;
+         }
 
-    // es: rellenar los bloques de datos con ceros
-    // en: write empty data blocks
-    memset(b, 0, BLOCK_SIZE) ;
-    for (int i=0; i < sblock.numDataBlocks; i++) {
-         bwrite(DISK, sblock.firstDataBlock + i, b) ;
+         // es: compartir el bloque (o recuperarlo si estaba libre)
+         // en: share the block (or bring it back if it was free)
+         if (b_map[block_id]) {
+             r_map[block_id]++ ;
+         }
+         else {
+             b_map[block_id] = 1 ;
+             r_map[block_id] = 1 ;
+             g_free[block_id / sblock.groupBlocks]-- ;
+         }
+         bpool_put(b) ;
+         return block_id ;
     }
 
-    return 1;
+    bpool_put(b) ;
+    return -1 ;
 }
 
 
 /*
- * es: Funciones principales
- * en: Main functions
+ * es: Funciones para clústeres con escritura diferida (F_COMPRESS o F_DEDUP)
+ * en: Write-back cluster functions (F_COMPRESS or F_DEDUP)
+ *
+ * es: Un clúster son clusterBlocks bloques lógicos. Si al comprimirlo se ahorra
+ *     algún bloque, se guarda en los primeros k bloques, el resto de entradas
+ *     valen BLOCK_ZCLUSTER y c_map[primer bloque] guarda el tamaño comprimido.
+ * en: A cluster is clusterBlocks logical blocks. If compressing it saves at
+ *     least one block, it is stored in the first k blocks, the other entries
+ *     are BLOCK_ZCLUSTER and c_map[first block] keeps the compressed size.
+ *
+ * es: Con F_DEDUP los clústeres sin comprimir se deduplican bloque a bloque.
+ * en: With F_DEDUP, uncompressed clusters are deduplicated block by block.
  */
 
-int nanofs_open ( char *name )
+int nanofs_cluster_blocks ( int inodo_id, int cluster )
 {
-    int inodo_id ;
+    int left ;
 
-    // es: obtener inodo a partir del nombre
-    // en: get inode id from name
-    inodo_id = nanofs_namei(name) ;
-    if (inodo_id < 0) {
-        return inodo_id ;
+    // es: bloques del clúster con datos dentro del tamaño del fichero
+    // en: cluster blocks with data within the file size
+    left = (int)inodes.size[inodo_id] - cluster * sblock.clusterBlocks * sblock.blockSize ;
+    if (left <= 0) {
+        return 0 ;
     }
 
-    inodes_x[inodo_id].position = 0 ;
-    inodes_x[inodo_id].is_open  = 1 ;
-
-    return inodo_id ;
+    return min_value(sblock.clusterBlocks, (left + sblock.blockSize - 1) / sblock.blockSize) ;
 }
 
-int nanofs_close ( int fd )
+int nanofs_cluster_read ( int inodo_id, int cluster, char *buffer )
 {
-     // es: comprobar parámetros
-     // en: check params
-     if ( (fd < 0) || (fd >= sblock.numInodes) )
-     {
-         return -1 ;
-     }
+    int   ids[CLUSTER_BLOCKS] ;
+    char *bufs[CLUSTER_BLOCKS] ;
+    char *z ;
+    int   first, needed, head, block_id, k, ret ;
+
+    first  = cluster * sblock.clusterBlocks ;
+    needed = nanofs_cluster_blocks(inodo_id, cluster) ;
+    memset(buffer, 0, sblock.clusterBlocks * sblock.blockSize) ;
+    if (0 == needed) {
+        return 1 ;
+    }
 
-     inodes_x[fd].position = 0 ;
-     inodes_x[fd].is_open  = 0 ;
+    // es: clúster comprimido: leer los k bloques y descomprimir
+    // en: compressed cluster: read the k blocks and decompress
+    head = nanofs_bmap(inodo_id, first * sblock.blockSize) ;
+    if (-1 == head) {
+        return -1 ;
+    }
+    if ( (head >= 0) && (0 != c_map[head]) )
+    {
+        z = bpool_get(sblock.clusterBlocks * sblock.blockSize) ;
+        if (NULL == z) {
+            return -1 ;
+        }
+
+        ret = 1 ;
+        k   = (c_map[head] + sblock.blockSize - 1) / sblock.blockSize ;
+        for (int j=0; (j<k) && (ret >= 0); j++)
+        {
+             block_id = nanofs_bmap(inodo_id, (first + j) * sblock.blockSize) ;
+             if (block_id < 0) {
+                 ret = -1 ;
+             }
+             ids[j]  = sblock.firstDataBlock + block_id ;
+             bufs[j] = z + j*sblock.blockSize ;
+        }
+        if ( (ret >= 0) && (nanofs_bio(0, k, ids, bufs) < 0) ) {
+            ret = -1 ;
+        }
+
+        if ( (ret >= 0) && (lz_decompress(z, c_map[head], buffer, sblock.clusterBlocks * sblock.blockSize) < 0) ) {
+            ret = -1 ;
+        }
+        bpool_put(z) ;
+        return ret ;
+    }
 
-     return 1 ;
+    // es: clúster sin comprimir: leer todos los bloques a la vez (los huecos son ceros)
+    // en: uncompressed cluster: read all blocks at once (holes are zeros)
+    k = 0 ;
+    for (int j=0; j<needed; j++)
+    {
+         block_id = nanofs_bmap(inodo_id, (first + j) * sblock.blockSize) ;
+         if (BLOCK_NONE == block_id) {
+             continue ;
+         }
+         if (block_id < 0) {
+             return -1 ;
+         }
+         ids[k]  = sblock.firstDataBlock + block_id ;
+         bufs[k] = buffer + j*sblock.blockSize ;
+         k++ ;
+    }
+
+    return (k > 0) ? nanofs_bio(0, k, ids, bufs) : 1 ;
 }
 
-int nanofs_creat ( char *name )
+int nanofs_cluster_write ( int inodo_id, int cluster, char *buffer )
 {
-    int inodo_id ;
+    char *z ;
+    int   old[CLUSTER_BLOCKS] ;
+    int   ids[CLUSTER_BLOCKS] ;
+    char *bufs[CLUSTER_BLOCKS] ;
+    char *src ;
+    int   first, needed, valid, len, k, block_id, head, avail, m ;
+
+    first  = cluster * sblock.clusterBlocks ;
+    needed = nanofs_cluster_blocks(inodo_id, cluster) ;
+    if (0 == needed) {
+        return 1 ;
+    }
+    z = bpool_get(sblock.clusterBlocks * sblock.blockSize) ;
+    if (NULL == z) {
+        return -1 ;
+    }
+    valid  = min_value(sblock.clusterBlocks * sblock.blockSize, inodes.size[inodo_id] - first * sblock.blockSize) ;
 
-    // es: comprueba si existe el fichero
-    // en: check file exist
-    inodo_id = nanofs_namei(name) ;
-    if (inodo_id >= 0) {
+    // es: comprimir solo si se ahorra al menos un bloque
+    // en: compress only if at least one block is saved
+    len = -1 ;
+    if ( (sblock.features & F_COMPRESS) && (needed > 1) ) {
+        len = lz_compress(buffer, valid, z, (needed - 1) * sblock.blockSize) ;
+    }
+    if (len > 0)
+    {
+        k   = (len + sblock.blockSize - 1) / sblock.blockSize ;
+        src = z ;
+        memset(z + len, 0, k * sblock.blockSize - len) ;
+    }
+    else
+    {
+        k   = needed ;
+        src = buffer ;
+        len = 0 ;
+    }
+
+    // es: comprobar que hay sitio antes de tocar nada (bloques libres + los que tenía el clúster)
+    // en: check there is room before changing anything (free blocks + the ones the cluster had)
+    avail = nanofs_free_count() ;
+    for (int j=0; j<needed; j++)
+    {
+         old[j] = nanofs_bmap(inodo_id, (first + j) * sblock.blockSize) ;
+         if (-1 == old[j]) {
+             bpool_put(z) ;
+             return -1 ;
+         }
+         if (old[j] >= 0) {
+             avail++ ;
+         }
+    }
+    if ( (first + needed > 1) &&
+         ( (BLOCK_NONE == inodes.indirectBlock[inodo_id]) || (r_map[inodes.indirectBlock[inodo_id]] > 1) ) ) {
+        avail-- ;
+    }
+    if (avail < k) {
+        bpool_put(z) ;
         return -1 ;
     }
 
-    inodo_id = nanofs_ialloc() ;
-    if (inodo_id < 0) {
-        return inodo_id ;
+    // es: liberar los bloques que tenía el clúster
+    // en: free the blocks the cluster had
+    for (int j=0; j<needed; j++)
+    {
+         if (old[j] >= 0) {
+             nanofs_free(old[j]) ;
+         }
+    }
+    if (len > 0) {
+        stats.clustersCompressed++ ;
+    }
+    else {
+        stats.clustersRaw++ ;
     }
 
-    strcpy(inodes[inodo_id].name, name) ;
-    inodes[inodo_id].type           = T_FILE ;
-    inodes[inodo_id].directBlock[0] = -5 ;
-    inodes_x[inodo_id].position = 0 ;
-    inodes_x[inodo_id].is_open  = 1 ;
+    // es: escribir los k bloques (los nuevos se envían juntos al final)
+    // en: write the k blocks (the new ones are submitted together at the end)
+    head = BLOCK_NONE ;
+    m    = 0 ;
+    for (int j=0; j<k; j++)
+    {
+         // es: los bloques sin comprimir se comparten si ya existe una copia idéntica
+         // en: uncompressed blocks are shared if an identical copy already exists
+         uint64_t fingerprint = 0 ;
+         block_id = -1 ;
+         if ( (sblock.features & F_DEDUP) && (0 == len) )
+         {
+             fingerprint = nanofs_fingerprint(src + j*sblock.blockSize) ;
+             block_id    = nanofs_dedup_lookup(src + j*sblock.blockSize, fingerprint) ;
+             if (block_id >= 0) {
+                 stats.blocksDeduplicated++ ;
+             }
+         }
 
-    return inodo_id ;
+         if (block_id < 0)
+         {
+             block_id = nanofs_alloc_nozero(inodo_id) ;
+             if (block_id < 0) {
+                 bpool_put(z) ;
+                 return -1 ;
+             }
+             ids[m]  = sblock.firstDataBlock + block_id ;
+             bufs[m] = src + j*sblock.blockSize ;
+             m++ ;
+             if (0 != fingerprint) {
+                 nanofs_dedup_insert(block_id, fingerprint) ;
+             }
+         }
+
+         if (nanofs_bmap_set(inodo_id, first + j, block_id) < 0) {
+             bpool_put(z) ;
+             return -1 ;
+         }
+         if (0 == j) {
+             head = block_id ;
+         }
+    }
+
+    if ( (m > 0) && (nanofs_bio(1, m, ids, bufs) < 0) ) {
+        bpool_put(z) ;
+        return -1 ;
+    }
+
+    // es: marcar el resto del clúster comprimido
+    // en: mark the rest of the compressed cluster
+    c_map[head] = len ;
+    for (int j=k; j<needed; j++)
+    {
+         if (nanofs_bmap_set(inodo_id, first + j, BLOCK_ZCLUSTER) < 0) {
+             bpool_put(z) ;
+             return -1 ;
+         }
+    }
+
+    bpool_put(z) ;
+    return 1 ;
 }
 
-int nanofs_unlink ( char * name )
+int nanofs_cache_flush ( int fd )
 {
-     int inodo_id ;
+    // es: escribir el clúster en cache si está modificado
+    // en: write the cached cluster if dirty
+    if ( (NULL != inodes_x[fd].cache) && (inodes_x[fd].cache_dirty) )
+    {
+        if (nanofs_cluster_write(fd, inodes_x[fd].cache_cluster, inodes_x[fd].cache) < 0) {
+            return -1 ;
+        }
+        inodes_x[fd].cache_dirty = 0 ;
+    }
 
-     // es: obtener inodo a partir del nombre
-     // en: get inode id from name
-     inodo_id = nanofs_namei(name) ;
-     if (inodo_id < 0) {
-         return inodo_id ;
-     }
+    return 1 ;
+}
+
+int nanofs_cache_load ( int fd, int cluster )
+{
+    // es: reservar la cache la primera vez
+    // en: allocate the cache the first time
+    if (NULL == inodes_x[fd].cache)
+    {
+        inodes_x[fd].cache = bpool_get(sblock.clusterBlocks * sblock.blockSize) ;
+        if (NULL == inodes_x[fd].cache) {
+            return -1 ;
+        }
+        inodes_x[fd].cache_cluster = -1 ;
+        inodes_x[fd].cache_dirty   = 0 ;
+    }
+
+    // es: si ya está en cache -> hecho
+    // en: if already cached -> done
+    if (cluster == inodes_x[fd].cache_cluster) {
+        return 1 ;
+    }
 
-     nanofs_free(inodes[inodo_id].directBlock[0]) ;
-     memset(&(inodes[inodo_id]), 0, sizeof(TypeInodeDisk)) ;
-     nanofs_ifree(inodo_id) ;
+    // es: escribir el clúster anterior y leer el pedido
+    // en: write back the previous cluster and read the requested one
+    if (nanofs_cache_flush(fd) < 0) {
+        return -1 ;
+    }
+    inodes_x[fd].cache_cluster = -1 ;
+    if (nanofs_cluster_read(fd, cluster, inodes_x[fd].cache) < 0) {
+        return -1 ;
+    }
+    inodes_x[fd].cache_cluster = cluster ;
 
     return 1 ;
 }
 
-int nanofs_read ( int fd, char *buffer, int size )
+int nanofs_cache_free ( int fd )
 {
-     char b[BLOCK_SIZE] ;
+    int ret ;
 
-     // es: comprobar parámetros
-     // en: check params
-     if ( (fd < 0) || (fd >= sblock.numInodes) )
-     {
-         return -1 ;
-     }
+    // es: escribir lo pendiente y liberar la cache
+    // en: write pending data and free the cache
+    ret = nanofs_cache_flush(fd) ;
+    bpool_put(inodes_x[fd].cache) ;
+    inodes_x[fd].cache = NULL ;
+
+    return ret ;
+}
+
+int nanofs_cache_read ( int fd, char *buffer, int size )
+{
+     int cluster_size = sblock.clusterBlocks * sblock.blockSize ;
 
      int readed = 0 ;
      while (size > readed)
      {
-         // es: obtener bloque
-         // en: get block
-         int position_within_block = inodes_x[fd].position % BLOCK_SIZE ;
-         int to_read  = BLOCK_SIZE - position_within_block ;
-             to_read  = (to_read > size) ? size : to_read ;
-         int block_id = nanofs_bmap(fd, inodes_x[fd].position) ;
-
-         // es: lee-escribe bloque + toma porción pedida por el usuario
-         // en: read-write  block  + get portion requested by user
-         bread(DISK, sblock.firstDataBlock+block_id, b) ;
-         memmove(buffer+readed, b+position_within_block, to_read) ;
+         // es: obtener clúster
+         // en: get cluster
+         int cluster   = inodes_x[fd].position / cluster_size ;
+         int position_within_cluster = inodes_x[fd].position % cluster_size ;
+         int to_read   = min_value(cluster_size - position_within_cluster, size - readed) ;
+
+         if (nanofs_cache_load(fd, cluster) < 0) {
+             return -1 ;
+         }
+         memmove(buffer+readed, inodes_x[fd].cache+position_within_cluster, to_read) ;
 
          inodes_x[fd].position = inodes_x[fd].position + to_read ;
          readed = readed + to_read ;
@@ -523,75 +1362,2539 @@ int nanofs_read ( int fd, char *buffer, int size )
      return readed ;
 }
 
-int nanofs_write ( int fd, char *buffer, int size )
+int nanofs_cache_write ( int fd, char *buffer, int size )
 {
-     char b[BLOCK_SIZE] ;
-
-     // es: comprobar parámetros
-     // en: check params
-     if ( (fd < 0) || (fd >= sblock.numInodes) )
-     {
-         return -1 ;
-     }
+     int cluster_size = sblock.clusterBlocks * sblock.blockSize ;
 
      int written = 0 ;
      while (size > written)
      {
-         // es: obtener bloque
-         // en: get block
-         int position_within_block = inodes_x[fd].position % BLOCK_SIZE ;
-         int to_write = BLOCK_SIZE - position_within_block ;
-             to_write = (to_write > size) ? size : to_write ;
-
-         int block_id = nanofs_bmap(fd, inodes_x[fd].position) ;
-         if (-5 == block_id) {
-             block_id = nanofs_alloc() ;
-             if (block_id < 0) {
-                 return -1 ;
-             }
-             inodes[fd].directBlock[0] = block_id ;
+         // es: obtener clúster
+         // en: get cluster
+         int cluster   = inodes_x[fd].position / cluster_size ;
+         int position_within_cluster = inodes_x[fd].position % cluster_size ;
+         int to_write  = min_value(cluster_size - position_within_cluster, size - written) ;
+
+         if (nanofs_cache_load(fd, cluster) < 0) {
+             return -1 ;
          }
-
-         // es: lee bloque + toma porción pedida por el usuario
-         // en: read block + get portion requested by user
-         bread(DISK, sblock.firstDataBlock+block_id, b) ;
-         memmove(b+position_within_block, buffer+written, to_write) ;
-         bwrite(DISK, sblock.firstDataBlock+block_id, b) ;
+         memmove(inodes_x[fd].cache+position_within_cluster, buffer+written, to_write) ;
+         inodes_x[fd].cache_dirty = 1 ;
 
          inodes_x[fd].position = inodes_x[fd].position + to_write ;
-           inodes[fd].size     = max_value(inodes_x[fd].position, inodes[fd].size) ;
+           inodes.size[fd]     = max_value(inodes_x[fd].position, inodes.size[fd]) ;
          written = written + to_write ;
      }
 
      return written ;
 }
 
-int nanofs_lseek ( int fd, int offset, int whence )
+
+/*
+ * es: Peticiones asíncronas
+ * en: Asynchronous requests
+ *
+ * es: Cada petición se planifica al enviarla (posición, tamaño y, en las escrituras,
+ *     reserva de bloques y copia en escritura) y se reparte en bloques que van por
+ *     baio_submit, hasta ASYNC_SLOTS a la vez entre todas las peticiones. Los bloques
+ *     avanzan al llamar a poll/wait: una escritura parcial lee el bloque, mezcla los
+ *     datos y lo escribe. Las peticiones de un mismo fichero que se solapan (y alguna
+ *     escribe) esperan a las anteriores.
+ * en: Each request is planned on submission (position, size and, on writes, block
+ *     allocation and copy-on-write) and split into blocks that go through baio_submit,
+ *     up to ASYNC_SLOTS at the same time among all the requests. Blocks move on when
+ *     poll/wait is called: a partial write reads the block, merges the data and writes
+ *     it. Overlapping requests of the same file (when any of them writes) wait for the
+ *     previous ones.
+ */
+
+int nanofs_async_fd ( void )
 {
-     // es: comprobar parámetros
-     // en: check params
-     if ( (fd < 0) || (fd >= sblock.numInodes) )
+     unsigned int n = 0 ;
+
+     // es: eventfd (no bloqueante) que se avisa al completarse cada bloque o petición
+     // en: eventfd (non-blocking) notified when each block or request is completed
+     if (-1 != async.event_fd) {
+         return async.event_fd ;
+     }
+
+     // es: al crearlo empieza con las completadas sin recoger (+1 si hay alguna en curso,
+     //     por si ya ha terminado algún bloque que nadie ha recogido)
+     // en: when created it starts with the completed ones not reaped (+1 if any is in
+     //     flight, in case a block already finished and no one has reaped it)
+     for (TypeFileRequest *request = async.done; NULL != request; request = request->next) {
+          n++ ;
+     }
+     if (NULL != async.active) {
+         n++ ;
+     }
+     async.event_fd = eventfd(n, EFD_NONBLOCK | EFD_CLOEXEC) ;
+     if (-1 != async.event_fd) {
+         baio_notify(async.event_fd) ;
+     }
+
+     return async.event_fd ;
+}
+
+void nanofs_async_complete ( TypeFileRequest *request, int result )
+{
+     // es: dejarla en completadas y avisar por el eventfd
+     // en: put it in the completed queue and notify through the eventfd
+     request->result = result ;
+     request->next   = NULL ;
+     if (NULL == async.done) {
+         async.done = request ;
+     }
+     else {
+         async.done_last->next = request ;
+     }
+     async.done_last = request ;
+     if (-1 != async.event_fd) {
+         eventfd_write(async.event_fd, 1) ;
+     }
+}
+
+char *nanofs_async_range ( TypeAsyncState *state, int i, int *from, int *to )
+{
+     int start = (state->first_block + i) * sblock.blockSize ;
+
+     // es: porción [from, to) del bloque i que toca la petición y sus datos en el buffer del usuario
+     // en: portion [from, to) of block i covered by the request and its data in the user buffer
+     *from = max_value(state->offset, start) - start ;
+     *to   = min_value(state->offset + state->length, start + sblock.blockSize) - start ;
+
+     return state->request->buffer + (start + *from - state->offset) ;
+}
+
+void nanofs_async_issue ( TypeAsyncSlot *slot )
+{
+     // es: enviarlo por baio (si no se puede, se hace aquí y queda ya completado)
+     // en: submit it through baio (if not possible, it is done here and is already completed)
+     slot->breq.devname   = device_name ;
+     slot->breq.callback  = NULL ;
+     slot->breq.user_data = slot ;
+     if (baio_submit(&(slot->breq)) < 0)
      {
-         return -1 ;
+         if (slot->breq.is_write) {
+             slot->breq.result = bwrite(device_name, slot->breq.bid, slot->breq.buffer) ;
+         }
+         else {
+             slot->breq.result = bread(device_name, slot->breq.bid, slot->breq.buffer) ;
+         }
+         slot->breq.done = 1 ;
      }
+}
 
-     // es: salta a la posici'on pedida
-     // en: seek to the requested offset
-     switch (whence) 
+void nanofs_async_merge ( TypeAsyncSlot *slot )
+{
+     TypeAsyncState *state = slot->state ;
+     int   from, to ;
+     char *data = nanofs_async_range(state, slot->index, &from, &to) ;
+
+     // es: poner los datos del usuario en el bloque y escribirlo (la suma de control antes de escribir)
+     // en: put the user data in the block and write it (the checksum before writing)
+     memcpy((char *)slot->breq.buffer + from, data, to - from) ;
+     slot->breq.bid      = sblock.firstDataBlock + state->write_ids[slot->index] ;
+     slot->breq.is_write = 1 ;
+     if (NULL != crc_map) {
+         crc_map[slot->breq.bid] = crc32c(0, slot->breq.buffer, sblock.blockSize) ;
+     }
+     stats.blocksWritten++ ;
+     nanofs_async_issue(slot) ;
+}
+
+void nanofs_async_start ( TypeAsyncSlot *slot )
+{
+     TypeAsyncState *state = slot->state ;
+     int   i = slot->index ;
+     int   from, to ;
+
+     // es: leer el bloque (lecturas y escrituras parciales de un bloque con datos)
+     // en: read the block (reads and partial writes of a block with data)
+     nanofs_async_range(state, i, &from, &to) ;
+     if ( (! state->request->is_write) ||
+          ( (BLOCK_NONE != state->read_ids[i]) && ( (from > 0) || (to < sblock.blockSize) ) ) )
      {
-         case SEEK_SET:
-              inodes_x[fd].position = offset ;
-              break ;
-         case SEEK_CUR:
-              inodes_x[fd].position = inodes_x[fd].position + offset ;
-              break ;
-         case SEEK_END:
-              inodes_x[fd].position = inodes[fd].size + offset ;
-              break ;
+         slot->breq.bid      = sblock.firstDataBlock + state->read_ids[i] ;
+         slot->breq.is_write = 0 ;
+         nanofs_async_issue(slot) ;
+         return ;
      }
 
-     // es: devolver posici'on resultante
-     // en: return current position
-     return inodes_x[fd].position ;
+     // es: escribir sin leer (bloque completo, o bloque nuevo: lo que no se escribe son ceros)
+     // en: write without reading (full block, or new block: what is not written are zeros)
+     if ( (from > 0) || (to < sblock.blockSize) ) {
+         memset(slot->breq.buffer, 0, sblock.blockSize) ;
+     }
+     nanofs_async_merge(slot) ;
+}
+
+int nanofs_async_step ( TypeAsyncSlot *slot )
+{
+     TypeAsyncState *state = slot->state ;
+     int   from, to ;
+     char *data ;
+
+     // es: bloque con error -> petición con error
+     // en: block with an error -> request with an error
+     if (slot->breq.result < 0) {
+         state->error = 1 ;
+         return 0 ;
+     }
+
+     // es: escritura terminada -> bloque terminado
+     // en: write finished -> block finished
+     if (slot->breq.is_write) {
+         return 0 ;
+     }
+
+     // es: lectura terminada: comprobar la suma de control
+     // en: read finished: check the checksum
+     stats.blocksRead++ ;
+     if ( (NULL != crc_map) && (crc_map[slot->breq.bid] != crc32c(0, slot->breq.buffer, sblock.blockSize)) ) {
+         stats.checksumErrors++ ;
+         state->error = 1 ;
+         return 0 ;
+     }
+
+     // es: lectura -> tomar la porción pedida; escritura parcial -> mezclar y escribir
+     // en: read -> get the portion requested; partial write -> merge and write
+     if (! state->request->is_write) {
+         data = nanofs_async_range(state, slot->index, &from, &to) ;
+         memcpy(data, (char *)slot->breq.buffer + from, to - from) ;
+         return 0 ;
+     }
+     nanofs_async_merge(slot) ;
+
+     return 1 ;
+}
+
+int nanofs_async_eligible ( TypeAsyncState *state )
+{
+     // es: espera a las anteriores del mismo fichero que tocan sus bloques (si alguna escribe)
+     // en: it waits for the previous ones of the same file using its blocks (if any of them writes)
+     for (TypeAsyncState *prev = async.active; prev != state; prev = prev->next)
+     {
+          if ( (prev->request->fd != state->request->fd) ||
+               ( (! prev->request->is_write) && (! state->request->is_write) ) ) {
+              continue ;
+          }
+          if ( (prev->first_block < state->first_block + state->num_blocks) &&
+               (state->first_block < prev->first_block + prev->num_blocks) ) {
+              return 0 ;
+          }
+     }
+
+     return 1 ;
 }
 
+void nanofs_async_finish ( TypeAsyncState *state )
+{
+     TypeAsyncState **prev ;
+
+     // es: quitarla de las que están en curso
+     // en: remove it from the ones in flight
+     for (prev = &(async.active); *prev != state; prev = &((*prev)->next)) {
+          ;
+     }
+     *prev = state->next ;
+     if (async.active_last == state) {
+         async.active_last = NULL ;
+         for (TypeAsyncState *s = async.active; NULL != s; s = s->next) {
+              async.active_last = s ;
+         }
+     }
+
+     // es: una escritura completa puede hacer crecer el fichero
+     // en: a completed write may make the file grow
+     if ( (state->request->is_write) && (0 == state->error) ) {
+         inodes.size[state->request->fd] = max_value(state->offset + state->length, inodes.size[state->request->fd]) ;
+     }
+
+     nanofs_async_complete(state->request, state->error ? -1 : state->length) ;
+     free(state) ;
+}
+
+int nanofs_async_pump ( void )
+{
+     TypeAsyncState *state, *next ;
+     TypeAsyncSlot  *slot ;
+     int progress = 0 ;
+     int k = 0 ;
+
+     // es: avanzar los bloques completados (una lectura para modificar pasa a escritura)
+     // en: move the completed blocks on (a read for a modify becomes a write)
+     for (int i=0; i<ASYNC_SLOTS; i++)
+     {
+          slot = &(async.slots[i]) ;
+          if ( (NULL == slot->state) || (0 == slot->breq.done) ) {
+              continue ;
+          }
+          progress = 1 ;
+          if (nanofs_async_step(slot) > 0) {
+              continue ;
+          }
+          slot->state->pending-- ;
+          slot->state = NULL ;
+     }
+
+     // es: empezar bloques nuevos en orden de envío y terminar las peticiones sin bloques pendientes
+     // en: start new blocks in submission order and finish the requests without pending blocks
+     for (state = async.active; NULL != state; state = next)
+     {
+          next = state->next ;
+          if (nanofs_async_eligible(state))
+          {
+              while (state->next_block < state->num_blocks)
+              {
+                   int i = state->next_block ;
+                   int from, to ;
+
+                   // es: un hueco se lee como ceros
+                   // en: a hole is read as zeros
+                   if ( (! state->request->is_write) && (BLOCK_NONE == state->read_ids[i]) ) {
+                       char *data = nanofs_async_range(state, i, &from, &to) ;
+                       memset(data, 0, to - from) ;
+                       state->next_block++ ;
+                       progress = 1 ;
+                       continue ;
+                   }
+
+                   // es: un hueco libre (si no hay, se sigue en el siguiente pump)
+                   // en: a free slot (if there is none, it goes on in the next pump)
+                   while ( (k < ASYNC_SLOTS) && (NULL != async.slots[k].state) ) {
+                       k++ ;
+                   }
+                   if (k == ASYNC_SLOTS) {
+                       break ;
+                   }
+                   slot = &(async.slots[k]) ;
+                   slot->state = state ;
+                   slot->index = i ;
+                   state->next_block++ ;
+                   state->pending++ ;
+                   progress = 1 ;
+                   nanofs_async_start(slot) ;
+              }
+          }
+          if ( (state->next_block == state->num_blocks) && (0 == state->pending) ) {
+              nanofs_async_finish(state) ;
+          }
+     }
+
+     return progress ;
+}
+
+void nanofs_async_kick ( void )
+{
+     // es: avanzar hasta que no haya nada más que hacer (baio_poll envía lo que haya encolado el pump)
+     // en: move on until there is nothing else to do (baio_poll submits what the pump has queued)
+     while (nanofs_async_pump() > 0) {
+         baio_poll() ;
+     }
+}
+
+int nanofs_async_busy ( int fd )
+{
+     // es: alguna en curso en fd (-1: en cualquiera)
+     // en: any in flight on fd (-1: on any of them)
+     for (TypeAsyncState *state = async.active; NULL != state; state = state->next)
+     {
+          if ( (-1 == fd) || (state->request->fd == fd) ) {
+              return 1 ;
+          }
+     }
+
+     return 0 ;
+}
+
+int nanofs_async_drain ( int fd )
+{
+     // es: esperar a las que estén en curso en fd (-1: todas); se recogen después con poll/wait
+     // en: wait for the ones in flight on fd (-1: all of them); they are reaped later with poll/wait
+     nanofs_async_kick() ;
+     while (nanofs_async_busy(fd))
+     {
+         if (baio_wait(NULL) < 0) {
+             return -1 ;
+         }
+         nanofs_async_kick() ;
+     }
+
+     return 1 ;
+}
+
+int nanofs_async_plan ( TypeAsyncState *state )
+{
+     int fd  = state->request->fd ;
+     int num = state->num_blocks ;
+     int fresh = 0 ;
+
+     // es: bloques actuales (también los de las escrituras en curso, ya enlazados)
+     // en: current blocks (also the ones of the writes in flight, already linked)
+     if (nanofs_bmapn(fd, state->first_block, num, state->read_ids) < 0) {
+         return -1 ;
+     }
+     for (int i=0; i<num; i++)
+     {
+          if ( (state->read_ids[i] < 0) && (BLOCK_NONE != state->read_ids[i]) ) {
+              return -1 ;
+          }
+     }
+     if (! state->request->is_write) {
+         return 1 ;
+     }
+
+     // es: bloque nuevo para los huecos y los compartidos (copia en escritura); sin espacio
+     //     la escritura se queda corta
+     // en: new block for holes and shared ones (copy-on-write); without space the write
+     //     becomes a short one
+     for (int i=0; i<num; i++)
+     {
+          state->write_ids[i] = state->read_ids[i] ;
+          if ( (BLOCK_NONE != state->read_ids[i]) && (r_map[state->read_ids[i]] <= 1) ) {
+              continue ;
+          }
+          state->write_ids[i] = nanofs_alloc_nozero(fd) ;
+          if (state->write_ids[i] < 0) {
+              num = i ;
+              break ;
+          }
+          fresh++ ;
+     }
+     if (0 == num) {
+         return -1 ;
+     }
+
+     // es: enlazarlos todos a la vez (el indirecto se escribe una sola vez)
+     // en: link all of them at once (the indirect one is written only once)
+     if ( (fresh > 0) && (nanofs_bmap_setn(fd, state->first_block, num, state->write_ids) < 0) )
+     {
+         for (int i=0; i<num; i++)
+         {
+              if (state->write_ids[i] != state->read_ids[i]) {
+                  nanofs_free(state->write_ids[i]) ;
+              }
+         }
+         return -1 ;
+     }
+
+     // es: soltar la referencia a los compartidos (siguen vivos en el otro árbol para leerlos)
+     // en: drop the reference to the shared ones (they stay alive in the other tree to be read)
+     for (int i=0; i<num; i++)
+     {
+          if ( (state->write_ids[i] != state->read_ids[i]) && (BLOCK_NONE != state->read_ids[i]) ) {
+              nanofs_free(state->read_ids[i]) ;
+              stats.blocksCopiedOnWrite++ ;
+          }
+     }
+     state->num_blocks = num ;
+     state->length     = min_value(state->length, (state->first_block + num) * sblock.blockSize - state->offset) ;
+
+     return 1 ;
+}
+
+int nanofs_async_submit ( TypeFileRequest *request, int is_write )
+{
+     TypeAsyncState *state ;
+     int fd, offset, length, end, position, ret ;
+
+     // es: comprobar parámetros
+     // en: check params
+     if ( (NULL == request) || (0 == is_mounted) ) {
+         return -1 ;
+     }
+     fd = request->fd ;
+     if ( (fd < 0) || (fd >= sblock.numInodes) || (0 == inodes_x[fd].is_open) ) {
+         return -1 ;
+     }
+
+     // es: bloques alineados para los que estén en curso (la primera vez tras montar)
+     // en: aligned blocks for the ones in flight (the first time after mount)
+     if (NULL == async.buffers)
+     {
+         int stride = max_value(sblock.blockSize, BLOCK_ALIGN) ;
+         async.buffers = bpool_get((size_t)ASYNC_SLOTS * stride) ;
+         if (NULL == async.buffers) {
+             return -1 ;
+         }
+         for (int i=0; i<ASYNC_SLOTS; i++) {
+              async.slots[i].breq.buffer = async.buffers + (size_t)i * stride ;
+              async.slots[i].state       = NULL ;
+         }
+     }
+
+     request->is_write = is_write ;
+     request->result   = -1 ;
+     request->done     = 0 ;
+     request->next     = NULL ;
+
+     // es: posición (-1: la del fichero, que avanza ya al enviarla)
+     // en: position (-1: the file one, which moves forward on submission)
+     offset = (request->offset < 0) ? inodes_x[fd].position : request->offset ;
+
+     // es: ficheros con escritura diferida por clústeres: se hace ya (queda completada)
+     // en: files with write-back clusters: it is done now (it is left completed)
+     if (sblock.features & (F_COMPRESS | F_DEDUP))
+     {
+         position = inodes_x[fd].position ;
+         inodes_x[fd].position = offset ;
+         ret = is_write ? nanofs_write(fd, request->buffer, request->size) : nanofs_read(fd, request->buffer, request->size) ;
+         if (request->offset >= 0) {
+             inodes_x[fd].position = position ;
+         }
+         async.inflight++ ;
+         nanofs_async_complete(request, ret) ;
+         return 1 ;
+     }
+
+     // es: tamaño: sin pasar del máximo al escribir ni del final (con las escrituras en curso) al leer
+     // en: size: not beyond the maximum on writes nor the end (with the writes in flight) on reads
+     if (is_write)
+     {
+         length = min_value(request->size, nanofs_maxsize() - offset) ;
+         ret    = ( (is_readonly) || ( (request->size > 0) && (length <= 0) ) ) ? -1 : 0 ;
+     }
+     else
+     {
+         end = inodes.size[fd] ;
+         for (state = async.active; NULL != state; state = state->next)
+         {
+              if ( (state->request->fd == fd) && (state->request->is_write) ) {
+                  end = max_value(end, state->offset + state->length) ;
+              }
+         }
+         length = min_value(request->size, end - offset) ;
+         ret    = 0 ;
+     }
+     if ( (ret < 0) || (length <= 0) ) {
+         async.inflight++ ;
+         nanofs_async_complete(request, ret) ;
+         return 1 ;
+     }
+
+     // es: planificarla en bloques
+     // en: plan it in blocks
+     int first = offset / sblock.blockSize ;
+     int num   = (offset + length - 1) / sblock.blockSize - first + 1 ;
+     state = malloc(sizeof(TypeAsyncState) + 2 * num * sizeof(int)) ;
+     if (NULL == state) {
+         return -1 ;
+     }
+     memset(state, 0, sizeof(TypeAsyncState)) ;
+     state->request     = request ;
+     state->offset      = offset ;
+     state->length      = length ;
+     state->first_block = first ;
+     state->num_blocks  = num ;
+     state->read_ids    = state->ids ;
+     state->write_ids   = state->ids + num ;
+     async.inflight++ ;
+     if (nanofs_async_plan(state) < 0) {
+         free(state) ;
+         nanofs_async_complete(request, -1) ;
+         return 1 ;
+     }
+     if (request->offset < 0) {
+         inodes_x[fd].position = offset + state->length ;
+     }
+
+     // es: ponerla en curso y empezar sus bloques
+     // en: put it in flight and start its blocks
+     if (NULL == async.active) {
+         async.active = state ;
+     }
+     else {
+         async.active_last->next = state ;
+     }
+     async.active_last = state ;
+     nanofs_async_kick() ;
+
+     return 1 ;
+}
+
+int nanofs_read_async ( TypeFileRequest *request )
+{
+     return nanofs_async_submit(request, 0) ;
+}
+
+int nanofs_write_async ( TypeFileRequest *request )
+{
+     return nanofs_async_submit(request, 1) ;
+}
+
+int nanofs_async_reap ( int wait )
+{
+     TypeFileRequest *request, *next ;
+     eventfd_t count ;
+     int n = 0 ;
+
+     if (0 == async.inflight) {
+         return wait ? -1 : 0 ;
+     }
+
+     // es: avanzar los bloques completados (esperando a alguno si se pide y no hay completadas)
+     // en: move the completed blocks on (waiting for one if asked and there is none completed)
+     if (-1 != async.event_fd) {
+         eventfd_read(async.event_fd, &count) ;  // es: vuelve a cero / en: back to zero
+     }
+     baio_poll() ;
+     nanofs_async_kick() ;
+     while ( (wait) && (NULL == async.done) )
+     {
+         if (baio_wait(NULL) < 0) {
+             return -1 ;
+         }
+         nanofs_async_kick() ;
+     }
+
+     // es: marcarlas como hechas y llamar a su callback (en este hilo)
+     // en: mark them as done and call their callback (in this thread)
+     request    = async.done ;
+     async.done = NULL ;
+     while (NULL != request)
+     {
+         next = request->next ;
+         async.inflight-- ;
+         request->done = 1 ;
+         if (NULL != request->callback) {
+             request->callback(request) ;
+         }
+         request = next ;
+         n++ ;
+     }
+
+     return n ;
+}
+
+int nanofs_async_poll ( void )
+{
+     return nanofs_async_reap(0) ;
+}
+
+int nanofs_async_wait ( TypeFileRequest *request )
+{
+     int n = 0 ;
+
+     // es: NULL -> esperar a cualquiera, si no -> esperar a esa petición
+     // en: NULL -> wait for any request, otherwise -> wait for that request
+     while ( (NULL == request) ? (0 == n) : (! request->done) )
+     {
+         int ret = nanofs_async_reap(1) ;
+         if (ret < 0) {
+             return -1 ;
+         }
+         n += ret ;
+     }
+
+     return (NULL == request) ? n : request->result ;
+}
+
+int nanofs_async_stop ( void )
+{
+     // es: recoger todas las peticiones en curso
+     // en: reap all the requests in flight
+     while (nanofs_async_reap(1) >= 0) {
+         ;
+     }
+
+     // es: cerrar el eventfd y soltar los bloques (se crean otros tras montar)
+     // en: close the eventfd and release the blocks (other ones are created after mount)
+     if (-1 != async.event_fd) {
+         baio_notify(-1) ;
+         close(async.event_fd) ;
+         async.event_fd = -1 ;
+     }
+     bpool_put(async.buffers) ;
+     async.buffers = NULL ;
+
+     return 1 ;
+}
+
+
+/*
+ * es: Funciones auxiliares para mkfs, mount y umount
+ * en: Auxiliar functions for mkfs, mount, and umount
+ */
+
+uint32_t nanofs_meta_crcSuperblock ( void )
+{
+    TypeSuperblock sb ;
+
+    // es: CRC32C del superbloque con el campo crcSuperblock a cero
+    // en: CRC32C of the superblock with the crcSuperblock field set to zero
+    memmove(&sb, &(sblock), sizeof(TypeSuperblock)) ;
+    sb.crcSuperblock = 0 ;
+
+    return crc32c(0, &sb, sizeof(TypeSuperblock)) ;
+}
+
+int nanofs_snapshot_block ( int snapshot_id )
+{
+    // es: primer bloque del hueco (i-nodos seguidos de nombres)
+    // en: first block of the slot (i-nodes followed by names)
+    return sblock.firstSnapshotBlock + snapshot_id * (sblock.numInodesBlocks + sblock.numNamesBlocks) ;
+}
+
+int nanofs_meta_freeMaps ( void )
+{
+    // es: liberar los mapas en memoria (si los hay)
+    // en: free the in-memory maps (if any)
+    bpool_put(crc_map) ; crc_map = NULL ;
+    free(b_map) ;    b_map   = NULL ;
+    free(c_map) ;    c_map   = NULL ;
+    free(r_map) ;    r_map   = NULL ;
+    free(f_map) ;    f_map   = NULL ;
+    free(f_index) ;  f_index = NULL ;
+    free(g_free) ;   g_free  = NULL ;
+    free(g_inodes) ; g_inodes = NULL ;
+
+    return 1 ;
+}
+
+int nanofs_meta_allocMaps ( void )
+{
+    // es: liberar los mapas anteriores (si los hay)
+    // en: free the previous maps (if any)
+    nanofs_meta_freeMaps() ;
+
+    // es: una entrada por bloque de datos (el índice de huellas tiene el doble)
+    // en: one entry per data block (the fingerprint index has twice as many)
+    b_map   = calloc(sblock.numDataBlocks,   sizeof(TypeBlockMap)) ;
+    c_map   = calloc(sblock.numDataBlocks,   sizeof(TypeClusterMap)) ;
+    r_map   = calloc(sblock.numDataBlocks,   sizeof(TypeRefMap)) ;
+    f_map   = calloc(sblock.numDataBlocks,   sizeof(TypeFingerprintMap)) ;
+    f_index = calloc(2*sblock.numDataBlocks, sizeof(*f_index)) ;
+    g_free  = calloc(sblock.numGroups,       sizeof(uint32_t)) ;
+    g_inodes = calloc(sblock.numGroups,      sizeof(uint32_t)) ;
+    if ( (NULL == b_map) || (NULL == c_map) || (NULL == r_map) || (NULL == f_map) || (NULL == f_index) ||
+         (NULL == g_free) || (NULL == g_inodes) ) {
+        nanofs_meta_freeMaps() ;
+        return -1 ;
+    }
+
+    // es: reservar un bloque completo por cada bloque del área de sumas de control
+    // en: allocate a full block for each block of the checksum area
+    if (sblock.features & F_CHECKSUM)
+    {
+        crc_map = bpool_get(sblock.numCrcBlocks * sblock.blockSize) ;
+        if (NULL == crc_map) {
+            nanofs_meta_freeMaps() ;
+            return -1 ;
+        }
+        memset(crc_map, 0, sblock.numCrcBlocks * sblock.blockSize) ;
+    }
+
+    return 1 ;
+}
+
+int nanofs_meta_countGroups ( void )
+{
+    // es: bloques libres de cada grupo (su parte de b_map)
+    // en: free blocks of each group (its share of b_map)
+    memset(g_free, 0, sblock.numGroups * sizeof(uint32_t)) ;
+    for (int i=0; i<sblock.numDataBlocks; i++) {
+         g_free[i / sblock.groupBlocks] += (0 == b_map[i]) ;
+    }
+
+    // es: i-nodos en uso de cada grupo (su parte de i_map)
+    // en: i-nodes in use of each group (its share of i_map)
+    memset(g_inodes, 0, sblock.numGroups * sizeof(uint32_t)) ;
+    for (int i=0; i<sblock.numInodes; i++) {
+         g_inodes[nanofs_igroup(i)] += (0 != i_map[i]) ;
+    }
+
+    return 1 ;
+}
+
+int nanofs_meta_readMaps ( void )
+{
+    char  *b ;
+    size_t offset ;
+
+    // es: leer todos los bloques de mapas a un único buffer
+    // en: read all map blocks into a single buffer
+    b = bpool_get(sblock.numMapsBlocks * sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+    if (nanofs_bio_range(0, sblock.firstMapsBlock, sblock.numMapsBlocks, b, sblock.blockSize) < 0) {
+        bpool_put(b) ;
+        return -1 ;
+    }
+
+    // es: mapa de i-nodos seguido de los mapas de bloques de datos
+    // en: i-node map followed by the data block maps
+    offset = 0 ;
+    memmove(i_map, b+offset, sizeof(TypeInodeMap)) ;                             offset += sizeof(TypeInodeMap) ;
+    memmove(b_map, b+offset, sblock.numDataBlocks * sizeof(TypeBlockMap)) ;       offset += sblock.numDataBlocks * sizeof(TypeBlockMap) ;
+    memmove(c_map, b+offset, sblock.numDataBlocks * sizeof(TypeClusterMap)) ;     offset += sblock.numDataBlocks * sizeof(TypeClusterMap) ;
+    memmove(r_map, b+offset, sblock.numDataBlocks * sizeof(TypeRefMap)) ;         offset += sblock.numDataBlocks * sizeof(TypeRefMap) ;
+    memmove(f_map, b+offset, sblock.numDataBlocks * sizeof(TypeFingerprintMap)) ;
+
+    bpool_put(b) ;
+    return nanofs_meta_countGroups() ;
+}
+
+int nanofs_meta_writeMaps ( void )
+{
+    char  *b ;
+    size_t offset ;
+
+    // es: mapa de i-nodos seguido de los mapas de bloques de datos
+    // en: i-node map followed by the data block maps
+    b = bpool_get(sblock.numMapsBlocks * sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+    memset(b, 0, sblock.numMapsBlocks * sblock.blockSize) ;
+    offset = 0 ;
+    memmove(b+offset, i_map, sizeof(TypeInodeMap)) ;                             offset += sizeof(TypeInodeMap) ;
+    memmove(b+offset, b_map, sblock.numDataBlocks * sizeof(TypeBlockMap)) ;       offset += sblock.numDataBlocks * sizeof(TypeBlockMap) ;
+    memmove(b+offset, c_map, sblock.numDataBlocks * sizeof(TypeClusterMap)) ;     offset += sblock.numDataBlocks * sizeof(TypeClusterMap) ;
+    memmove(b+offset, r_map, sblock.numDataBlocks * sizeof(TypeRefMap)) ;         offset += sblock.numDataBlocks * sizeof(TypeRefMap) ;
+    memmove(b+offset, f_map, sblock.numDataBlocks * sizeof(TypeFingerprintMap)) ;
+
+    // es: escribir los bloques de mapas
+    // en: write the map blocks
+    int ret = nanofs_bio_range(1, sblock.firstMapsBlock, sblock.numMapsBlocks, b, sblock.blockSize) ;
+
+    bpool_put(b) ;
+    return (ret < 0) ? -1 : 1 ;
+}
+
+int nanofs_meta_readInodes ( int firstInodeBlock, int firstNamesBlock, TypeInodesMem *ino, TypeNameDisk *nam )
+{
+    char *b ;
+    TypeInodeDisk *d ;
+
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+
+    // es: leer los i-nodos a memoria
+    // en: read i-nodes to memory
+    int inodesLeftToRead = sblock.numInodes ;
+    for (int blocksRead=0; (inodesLeftToRead > 0); blocksRead++)
+    {
+         int inodesRead   = blocksRead*sblock.inodesPerBlock ;
+         int inodesToPack = min_value(inodesLeftToRead, sblock.inodesPerBlock) ;
+
+         if (nanofs_bread(firstInodeBlock+blocksRead, b) < 0) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+         d = (TypeInodeDisk *)b ;
+         for (int j=0; j<inodesToPack; j++)
+         {
+              ino->size[inodesRead+j]          = d[j].size ;
+              ino->type[inodesRead+j]          = d[j].type ;
+              ino->directBlock[inodesRead+j]   = d[j].directBlock[0] ;
+              ino->indirectBlock[inodesRead+j] = d[j].indirectBlock ;
+         }
+
+         inodesLeftToRead -= inodesToPack ;
+    }
+
+    // es: leer los nombres a memoria
+    // en: read names to memory
+    int namesLeftToRead = sblock.numInodes ;
+    for (int blocksRead=0; (namesLeftToRead > 0); blocksRead++)
+    {
+         int namesRead   = blocksRead*sblock.namesPerBlock ;
+         int namesToPack = min_value(namesLeftToRead, sblock.namesPerBlock) ;
+
+         if (nanofs_bread(firstNamesBlock+blocksRead, b) < 0) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+         memmove(&(nam[namesRead]), b, namesToPack*sizeof(TypeNameDisk)) ;
+         for (int j=0; j<namesToPack; j++) {
+              ino->nameHash[namesRead+j] = nam[namesRead+j].hash ;
+         }
+
+         namesLeftToRead -= namesToPack ;
+    }
+
+    bpool_put(b) ;
+    return 1 ;
+}
+
+int nanofs_meta_writeInodes ( int firstInodeBlock, int firstNamesBlock, TypeInodesMem *ino, TypeNameDisk *nam )
+{
+    char *b ;
+    TypeInodeDisk *d ;
+    int ret = 1 ;
+
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+
+    // es: escribir los i-nodos a disco
+    // en: write i-nodes to disk
+    int inodesLeftToWrite = sblock.numInodes ;
+    for (int blocksWritten=0; (inodesLeftToWrite > 0); blocksWritten++)
+    {
+         int inodesWritten = blocksWritten*sblock.inodesPerBlock ;
+         int inodesToPack  = min_value(inodesLeftToWrite, sblock.inodesPerBlock) ;
+
+          memset(b, 0, sblock.blockSize) ;
+         d = (TypeInodeDisk *)b ;
+         for (int j=0; j<inodesToPack; j++)
+         {
+              d[j].size           = ino->size[inodesWritten+j] ;
+              d[j].type           = ino->type[inodesWritten+j] ;
+              d[j].directBlock[0] = ino->directBlock[inodesWritten+j] ;
+              d[j].indirectBlock  = ino->indirectBlock[inodesWritten+j] ;
+         }
+         if (nanofs_bwrite(firstInodeBlock+blocksWritten, b) < 0) {
+             ret = -1 ;
+         }
+
+         inodesLeftToWrite -= inodesToPack ;
+    }
+
+    // es: escribir los nombres a disco
+    // en: write names to disk
+    int namesLeftToWrite = sblock.numInodes ;
+    for (int blocksWritten=0; (namesLeftToWrite > 0); blocksWritten++)
+    {
+         int namesWritten = blocksWritten*sblock.namesPerBlock ;
+         int namesToPack  = min_value(namesLeftToWrite, sblock.namesPerBlock) ;
+
+          memset(b, 0, sblock.blockSize) ;
+         memmove(b, &(nam[namesWritten]), namesToPack*sizeof(TypeNameDisk)) ;
+         if (nanofs_bwrite(firstNamesBlock+blocksWritten, b) < 0) {
+             ret = -1 ;
+         }
+
+         namesLeftToWrite -= namesToPack ;
+    }
+
+    bpool_put(b) ;
+    return ret ;
+}
+
+int nanofs_meta_readFromDisk ( int tolerant )
+{
+    uint32_t *crc_area ;
+    char *b ;
+    int   crc_ok = 1 ;
+    int   ret ;
+
+    // es: leer bloque 0 de disco en sblock (el superbloque cabe en el bloque más pequeño)
+    // en: read block 0 from disk to sbloques[0] (the superblock fits in the smallest block)
+    b = bpool_get(BLOCK_SIZE_MIN) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+    bsetsize(BLOCK_SIZE_MIN) ;
+    if (bread(device_name, 0, b) < 0) {
+        bpool_put(b) ;
+        return -1 ;
+    }
+    memmove(&(sblock), b, sizeof(TypeSuperblock)) ;
+    bpool_put(b) ;
+
+    // es: comprobar la versión antes de interpretar el resto del formato
+    // en: check the version before parsing the rest of the format
+    if ( (NANOFS_MAGIC != sblock.numMagic) || (NANOFS_VERSION != sblock.version) ) {
+        return -1 ;
+    }
+
+    // es: usar el tamaño de bloque del sistema de ficheros
+    // en: use the file system block size
+    if ( (bsetsize(sblock.blockSize) < 0) || (0 == sblock.groupBlocks) ||
+         (sblock.numGroups != (sblock.numDataBlocks + sblock.groupBlocks - 1) / sblock.groupBlocks) ) {
+        return -1 ;
+    }
+
+    // es: comprobar el superbloque y leer las sumas de control del resto de bloques
+    // en: check the superblock and read the checksums of the other blocks
+    if (nanofs_meta_allocMaps() < 0) {
+        return -1 ;
+    }
+    if (sblock.features & F_CHECKSUM)
+    {
+        if (sblock.crcSuperblock != nanofs_meta_crcSuperblock()) {
+            stats.checksumErrors++ ;
+            crc_ok = 0 ;
+        }
+
+        // es: todos en una sola petición (el área lleva su propia suma en el superbloque)
+        // en: all of them in a single request (the area has its own checksum in the superblock)
+        if (breadn(device_name, sblock.firstCrcBlock, sblock.numCrcBlocks, crc_map) < 0) {
+            return -1 ;
+        }
+        if ( (crc_ok) && (sblock.crcChecksums != crc32c(0, crc_map, sblock.numCrcBlocks * sblock.blockSize)) ) {
+            stats.checksumErrors++ ;
+            crc_ok = 0 ;
+        }
+        if ( (! crc_ok) && (! tolerant) ) {
+            return -1 ;
+        }
+    }
+
+    // es: con las sumas dañadas (solo fsck) los metadatos se leen sin comprobarlas
+    // en: with damaged checksums (fsck only) the metadata is read without checking them
+    crc_area = crc_map ;
+    if (! crc_ok) {
+        crc_map = NULL ;
+    }
+
+    // es: leer los bloques para el mapa de i-nodos y mapa de bloques de datos
+    // en: read the blocks where the i-node map and block map is stored
+    ret = nanofs_meta_readMaps() ;
+    if (ret >= 0) {
+        nanofs_dedup_rebuild() ;
+    }
+
+    // es: leer los i-nodos y nombres a memoria
+    // en: read i-nodes and names to memory
+    if (ret >= 0) {
+        ret = nanofs_meta_readInodes(sblock.firstInodeBlock, sblock.firstNamesBlock, &inodes, names) ;
+    }
+    crc_map = crc_area ;
+    if (ret < 0) {
+        return -1 ;
+    }
+    for (int i=0; i<sblock.numInodes; i++) {
+         inodes_x[i].goal = -1 ;
+    }
+
+    // es: 0 si se ha cargado con las sumas de control dañadas
+    // en: 0 if it was loaded with damaged checksums
+    return crc_ok ;
+}
+
+int nanofs_meta_writeToDisk ( void )
+{
+    char *b ;
+
+    // es: escribir los bloques para el mapa de i-nodos y el mapa de bloques de datos
+    // en: write the blocks where the i-node map and block map is stored
+    if (nanofs_meta_writeMaps() < 0) {
+        return -1 ;
+    }
+
+    // es: escribir los i-nodos y nombres a disco
+    // en: write i-nodes and names to disk
+    if (nanofs_meta_writeInodes(sblock.firstInodeBlock, sblock.firstNamesBlock, &inodes, names) < 0) {
+        return -1 ;
+    }
+
+    // es: escribir las sumas de control (tras el resto de bloques de metadatos) y su propia suma
+    // en: write the checksums (after the rest of metadata blocks) and their own checksum
+    if (sblock.numCrcBlocks > 0)
+    {
+        sblock.crcChecksums = crc32c(0, crc_map, sblock.numCrcBlocks * sblock.blockSize) ;
+        if (bwriten(device_name, sblock.firstCrcBlock, sblock.numCrcBlocks, crc_map) < 0) {
+            return -1 ;
+        }
+    }
+
+    // es: escribir bloque 0 de sblock a disco (el último, con las sumas ya calculadas)
+    // en: write block 0 to disk from sbloques[0] (the last one, with the checksums already computed)
+    if (sblock.features & F_CHECKSUM) {
+        sblock.crcSuperblock = nanofs_meta_crcSuperblock() ;
+    }
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        return -1 ;
+    }
+    memset(b, 0, sblock.blockSize) ;
+    memmove(b, &(sblock), sizeof(TypeSuperblock)) ;
+    if (bwrite(device_name, 0, b) < 0) {
+        bpool_put(b) ;
+        return -1 ;
+    }
+    bpool_put(b) ;
+
+    return 1 ;
+}
+
+int nanofs_meta_setDefault ( int dev_size, TypeMkfsOptions *options )
+{
+    int blockSize, fixedBlocks, numMapsBlocks, numDataBlocks, mapsBytes ;
+
+    // es: tamaño de bloque elegido (potencia de 2 entre BLOCK_SIZE_MIN y BLOCK_SIZE_MAX)
+    // en: chosen block size (power of 2 between BLOCK_SIZE_MIN and BLOCK_SIZE_MAX)
+    blockSize = (0 == options->blockSize) ? BLOCK_SIZE : options->blockSize ;
+    if (bsetsize(blockSize) < 0) {
+        return -1 ;
+    }
+
+    // es: inicializar a los valores por defecto del superbloque, mapas e i-nodos
+    // en: set the default values of the superblock, inode map, etc.
+    sblock.numMagic          = NANOFS_MAGIC ; // ayuda a comprobar que se haya creado por nuestro mkfs
+    sblock.version           = NANOFS_VERSION ;
+    sblock.blockSize         = blockSize ;
+    sblock.features          = options->features ;
+    sblock.clusterBlocks     = (sblock.features & F_COMPRESS) ? CLUSTER_BLOCKS : 1 ;
+    sblock.numInodes         = NUM_INODES ;
+    sblock.numInodesBlocks   = (NUM_INODES * sizeof(TypeInodeDisk) + sblock.blockSize - 1) / sblock.blockSize ;
+    sblock.inodesPerBlock    = sblock.blockSize / sizeof(TypeInodeDisk) ;
+    sblock.numNamesBlocks    = (NUM_INODES * sizeof(TypeNameDisk) + sblock.blockSize - 1) / sblock.blockSize ;
+    sblock.namesPerBlock     = sblock.blockSize / sizeof(TypeNameDisk) ;
+    sblock.numSnapshots      = min_value(options->numSnapshots, NUM_SNAPSHOTS) ;
+    sblock.snapshotMask      = 0 ;
+    sblock.sizeDevice        = dev_size ;
+    sblock.crcChecksums      = 0 ;
+    sblock.crcSuperblock     = 0 ;
+
+    // es: el área de sumas de control cubre todos los bloques del dispositivo, incluidos los suyos
+    // en: the checksum area covers all blocks of the device, including its own ones
+    sblock.numCrcBlocks      = 0 ;
+    if (sblock.features & F_CHECKSUM) {
+        sblock.numCrcBlocks  = ((long)dev_size * sizeof(uint32_t) + sblock.blockSize - 1) / sblock.blockSize ;
+    }
+
+    // es: el resto del dispositivo son mapas y datos (los mapas crecen con los bloques de datos)
+    // en: the rest of the device is maps and data (the maps grow with the data blocks)
+    fixedBlocks   = 1 + sblock.numInodesBlocks + sblock.numNamesBlocks +
+                    sblock.numSnapshots * (sblock.numInodesBlocks + sblock.numNamesBlocks) +
+                    sblock.numCrcBlocks ;
+    numMapsBlocks = 1 ;
+    for (;;)
+    {
+        numDataBlocks = max_value(dev_size - fixedBlocks - numMapsBlocks, 0) ;
+        mapsBytes     = sizeof(TypeInodeMap) +
+                        numDataBlocks * (sizeof(TypeBlockMap) + sizeof(TypeClusterMap) +
+                                         sizeof(TypeRefMap)   + sizeof(TypeFingerprintMap)) ;
+        if ((mapsBytes + sblock.blockSize - 1) / sblock.blockSize <= numMapsBlocks) {
+            break ;
+        }
+        numMapsBlocks = (mapsBytes + sblock.blockSize - 1) / sblock.blockSize ;
+    }
+    if (numDataBlocks < 1) {
+        return -1 ;
+    }
+
+    sblock.numDataBlocks     = numDataBlocks ;
+    sblock.numMapsBlocks     = numMapsBlocks ;
+
+    // es: grupos de bloques de datos (por defecto los que cubre un bloque de bits, como ext2)
+    // en: data block groups (by default the ones a bitmap block covers, as in ext2)
+    sblock.groupBlocks       = (0 == options->groupBlocks) ? 8 * blockSize : options->groupBlocks ;
+    sblock.numGroups         = (numDataBlocks + sblock.groupBlocks - 1) / sblock.groupBlocks ;
+    sblock.firstMapsBlock    = 1 ;
+    sblock.firstInodeBlock   = sblock.firstMapsBlock + sblock.numMapsBlocks ;
+    sblock.firstNamesBlock   = sblock.firstInodeBlock + sblock.numInodesBlocks ;
+    sblock.firstSnapshotBlock = sblock.firstNamesBlock + sblock.numNamesBlocks ;
+    sblock.firstCrcBlock     = sblock.firstSnapshotBlock +
+                               sblock.numSnapshots * (sblock.numInodesBlocks + sblock.numNamesBlocks) ;
+    sblock.firstDataBlock    = sblock.firstCrcBlock + sblock.numCrcBlocks ; // 1:sb + m:maps + n:inodes + m:names + s:snapshots + k:crc
+
+    if (nanofs_meta_allocMaps() < 0) {
+        return -1 ;
+    }
+
+    for (int i=0; i<sblock.numInodes; i++) {
+         i_map[i] = 0; // free
+    }
+
+    for (int i=0; i<sblock.numDataBlocks; i++) {
+         b_map[i] = 0; // free
+         c_map[i] = 0; // not compressed
+         r_map[i] = 0; // no references
+         f_map[i] = 0; // no fingerprint
+    }
+    nanofs_dedup_rebuild() ;
+    nanofs_meta_countGroups() ;
+
+    for (int i=0; i<sblock.numInodes; i++) {
+         nanofs_iclear(i) ;
+    }
+
+    return 1;
+}
+
+int nanofs_setdev ( char *devname )
+{
+    // es: no se cambia de dispositivo con uno montado
+    // en: the device is not changed while one is mounted
+    if ( (1 == is_mounted) || (NULL == devname) || (strlen(devname) > DEVICE_NAME_LENGTH) ) {
+        return -1 ;
+    }
+
+    strcpy(device_name, devname) ;
+
+    return 1 ;
+}
+
+int nanofs_mount ( void )
+{
+    if (1 == is_mounted) {
+        return -1 ;
+    }
+
+    // es: leer los metadatos del sistema de ficheros de disco a memoria
+    // en: read the metadata file system from disk
+    // es: (comprueba el número mágico y la versión del formato)
+    // en: (check magic number and format version)
+    if (nanofs_meta_readFromDisk(0) < 0) {
+        nanofs_meta_freeMaps() ;
+        return -1 ;
+    }
+    debug_print_sizeof() ;
+    debug_print_superblock() ;
+
+    // es: montar
+    // en: mounted
+    is_mounted  = 1 ; // 0: falso, 1: verdadero
+    is_readonly = 0 ;
+
+    return 1 ;
+}
+
+int nanofs_mount_snapshot ( int snapshot_id )
+{
+    if (1 == is_mounted) {
+        return -1 ;
+    }
+
+    // es: leer los metadatos del sistema de ficheros de disco a memoria
+    // en: read the metadata file system from disk
+    if (nanofs_meta_readFromDisk(0) < 0) {
+        nanofs_meta_freeMaps() ;
+        return -1 ;
+    }
+    debug_print_sizeof() ;
+    debug_print_superblock() ;
+
+    // es: sustituir los i-nodos y nombres por los de la instantánea
+    // en: replace i-nodes and names with the snapshot ones
+    if ( (snapshot_id < 0) || (snapshot_id >= sblock.numSnapshots) ||
+         (0 == (sblock.snapshotMask & (1 << snapshot_id))) ||
+         (nanofs_meta_readInodes(nanofs_snapshot_block(snapshot_id),
+                                 nanofs_snapshot_block(snapshot_id) + sblock.numInodesBlocks,
+                                 &inodes, names) < 0) )
+    {
+        nanofs_meta_freeMaps() ;
+        return -1 ;
+    }
+    for (int i=0; i<sblock.numInodes; i++) {
+         i_map[i] = (0 != inodes.nameHash[i]) ;
+    }
+    nanofs_meta_countGroups() ;
+
+    // es: montar en solo lectura
+    // en: mounted read-only
+    is_mounted  = 1 ;
+    is_readonly = 1 ;
+
+    return 1 ;
+}
+
+int nanofs_umount ( void )
+{
+    // es: si NO mountado -> error
+    // en: if NOT mounted -> error
+    if (0 == is_mounted) {
+        return -1 ;
+    }
+
+    // es: esperar a las peticiones asíncronas y cerrar su eventfd
+    // en: wait for the asynchronous requests and close their eventfd
+    nanofs_async_stop() ;
+
+    // es: si algún fichero está abierto -> error
+    // en: if any file is open -> error
+    for (int i=0; i<sblock.numInodes; i++) {
+    if (1 == inodes_x[i].is_open)
+        return -1 ;
+    }
+
+    // es: escribir los metadatos del sistema de ficheros de memoria a disco (salvo instantánea);
+    //     si falla sigue montado para poder reintentarlo
+    // en: write the metadata file system into disk (except for a snapshot);
+    //     on failure it stays mounted so that it can be retried
+    if (0 == is_readonly)
+    {
+        if (nanofs_meta_writeToDisk() < 0) {
+            return -1 ;
+        }
+        debug_print_sizeof() ;
+        debug_print_superblock() ;
+    }
+
+    nanofs_meta_freeMaps() ;
+    bclose(device_name) ;
+
+    // es: parar el motor de E/S asíncrona de bloques si lo arrancó nanofs (no si se llamó a baio_init)
+    // en: stop the asynchronous block I/O engine if nanofs started it (not if baio_init was called)
+    baio_release() ;
+
+    // es: desmontar
+    // en: unmounted
+    is_mounted = 0 ; // 0: falso, 1: verdadero
+
+    return 1 ;
+}
+
+int nanofs_mkfs_opts ( int dev_size, TypeMkfsOptions *options )
+{
+    // es: si montado -> error (se liberarían los mapas en uso)
+    // en: if mounted -> error (the maps in use would be freed)
+    if (1 == is_mounted) {
+        return -1 ;
+    }
+
+    // es: establecer los valores por defecto en memoria (incluido el tamaño de bloque)
+    // en: set default values in memory (block size included)
+    if (nanofs_meta_setDefault(dev_size, options) < 0) {
+        return -1 ;
+    }
+
+    // es: los bloques de datos no se rellenan con ceros (no se leen antes de escribirlos):
+    //     solo se escribe el último para que el dispositivo tenga su tamaño (un fichero
+    //     queda disperso) y los libres llevan la suma de control de un bloque a cero
+    // en: data blocks are not zero-filled (they are not read before being written):
+    //     only the last one is written so that the device has its size (a file is left
+    //     sparse) and the free ones get the checksum of a zero block
+    char *b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        nanofs_meta_freeMaps() ;
+        return -1 ;
+    }
+    memset(b, 0, sblock.blockSize) ;
+    if (NULL != crc_map)
+    {
+        uint32_t zero_crc = crc32c(0, b, sblock.blockSize) ;
+        for (int i=0; i<sblock.numDataBlocks; i++) {
+             crc_map[sblock.firstDataBlock + i] = zero_crc ;
+        }
+    }
+    int ret = nanofs_bwrite(sblock.firstDataBlock + sblock.numDataBlocks - 1, b) ;
+    bpool_put(b) ;
+
+    // es: escribir el sistema de ficheros inicial a disco (tras los datos, por las sumas de control)
+    // en: write the default file system into disk (after data, due to the checksums)
+    if (ret >= 0) {
+        ret = nanofs_meta_writeToDisk() ;
+    }
+    if (ret >= 0) {
+        debug_print_sizeof() ;
+        debug_print_superblock() ;
+    }
+
+    nanofs_meta_freeMaps() ;
+    bclose(device_name) ;
+
+    return (ret < 0) ? -1 : 1 ;
+}
+
+int nanofs_mkfs ( int dev_size )
+{
+    TypeMkfsOptions options ;
+
+    // es: opciones por defecto
+    // en: default options
+    memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+
+    return nanofs_mkfs_opts(dev_size, &options) ;
+}
+
+
+/*
+ * es: Funciones principales
+ * en: Main functions
+ */
+
+int nanofs_open ( char *name )
+{
+    int inodo_id ;
+
+    // es: obtener inodo a partir del nombre
+    // en: get inode id from name
+    inodo_id = nanofs_namei(name) ;
+    if (inodo_id < 0) {
+        return inodo_id ;
+    }
+
+    inodes_x[inodo_id].position = 0 ;
+    inodes_x[inodo_id].is_open  = 1 ;
+
+    return inodo_id ;
+}
+
+int nanofs_close ( int fd )
+{
+     // es: comprobar parámetros
+     // en: check params
+     if ( (fd < 0) || (fd >= sblock.numInodes) )
+     {
+         return -1 ;
+     }
+
+     // es: esperar a sus peticiones asíncronas (se recogen después con poll/wait)
+     // en: wait for its asynchronous requests (they are reaped later with poll/wait)
+     nanofs_async_drain(fd) ;
+
+     // es: escribir el clúster pendiente (si lo hay), se cierra igualmente si falla
+     // en: write back the pending cluster (if any), it is closed anyway on failure
+     int ret = nanofs_cache_free(fd) ;
+
+     inodes_x[fd].position = 0 ;
+     inodes_x[fd].is_open  = 0 ;
+
+     return (ret < 0) ? -1 : 1 ;
+}
+
+int nanofs_creat ( char *name )
+{
+    int inodo_id ;
+
+    // es: no se modifica una instantánea
+    // en: a snapshot is not modified
+    if (is_readonly) {
+        return -1 ;
+    }
+
+    // es: comprueba si existe el fichero
+    // en: check file exist
+    inodo_id = nanofs_namei(name) ;
+    if (inodo_id >= 0) {
+        return -1 ;
+    }
+
+    // es: comprueba la longitud del nombre
+    // en: check name length
+    if (strlen(name) > NAME_LENGTH) {
+        return -1 ;
+    }
+
+    inodo_id = nanofs_ialloc() ;
+    if (inodo_id < 0) {
+        return inodo_id ;
+    }
+
+    nanofs_iname(inodo_id, name, nanofs_namehash(name)) ;
+    inodes_x[inodo_id].position = 0 ;
+    inodes_x[inodo_id].is_open  = 1 ;
+
+    return inodo_id ;
+}
+
+int nanofs_unlink ( char * name )
+{
+     int inodo_id ;
+
+     // es: no se modifica una instantánea
+     // en: a snapshot is not modified
+     if (is_readonly) {
+         return -1 ;
+     }
+
+     // es: obtener inodo a partir del nombre
+     // en: get inode id from name
+     inodo_id = nanofs_namei(name) ;
+     if (inodo_id < 0) {
+         return inodo_id ;
+     }
+
+     // es: no se borra un fichero abierto (no podría desmontarse)
+     // en: an open file is not removed (it could not be unmounted)
+     if (inodes_x[inodo_id].is_open) {
+         return -1 ;
+     }
+
+     // es: un bloque compartido que lee una escritura asíncrona sigue vivo hasta que termine
+     // en: a shared block read by an asynchronous write stays alive until it finishes
+     nanofs_async_drain(-1) ;
+
+     nanofs_iremove(inodo_id) ;
+
+    return 1 ;
+}
+
+int nanofs_readdir ( int *position, char *name )
+{
+     // es: siguiente i-nodo con nombre desde *position (el espacio de nombres es plano)
+     // en: next i-node with a name from *position (the name space is flat)
+     for (int i=*position; i<sblock.numInodes; i++)
+     {
+          if (0 != inodes.nameHash[i])
+          {
+              strcpy(name, names[i].name) ;
+              *position = i + 1 ;
+              return 1 ;
+          }
+     }
+
+     *position = sblock.numInodes ;
+     return 0 ;
+}
+
+int nanofs_batch ( TypeBatchOp *ops, int n )
+{
+     struct {
+         uint32_t hash ;
+         char    *name ;
+         int      inodo_id ;  // es: i-nodo actual del nombre (-1: no existe)
+                              // en: current i-node of the name (-1: does not exist)
+     } *table ;
+     int *entry ;
+     int  size, mask, h, inodo_id, ok ;
+
+     // es: comprobar parámetros
+     // en: check params
+     if ( (0 == is_mounted) || (NULL == ops) || (n < 0) ) {
+         return -1 ;
+     }
+
+     // es: esperar a las peticiones asíncronas (como en nanofs_unlink)
+     // en: wait for the asynchronous requests (as in nanofs_unlink)
+     nanofs_async_drain(-1) ;
+
+     // es: tabla hash de los nombres distintos del lote (potencia de 2, al menos 2n)
+     // en: hash table of the distinct names of the batch (power of 2, at least 2n)
+     for (size=2; size < 2*n; size=size*2) ;
+     mask  = size - 1 ;
+     table = malloc(size * sizeof(*table) + n * sizeof(int)) ;
+     if (NULL == table) {
+         return -1 ;
+     }
+     entry = (int *)(table + size) ;
+     for (int i=0; i<size; i++) {
+          table[i].name = NULL ;
+     }
+
+     for (int j=0; j<n; j++)
+     {
+          entry[j] = -1 ;
+          if ( (NULL == ops[j].name) || (strlen(ops[j].name) > NAME_LENGTH) ) {
+              continue ;
+          }
+          h = nanofs_namehash(ops[j].name) ;
+          for (int k=h & mask; ; k=(k+1) & mask)
+          {
+               if (NULL == table[k].name) {
+                   table[k].hash     = h ;
+                   table[k].name     = ops[j].name ;
+                   table[k].inodo_id = -1 ;
+                   entry[j] = k ;
+                   break ;
+               }
+               if ( (table[k].hash == (uint32_t)h) && (! strcmp(table[k].name, ops[j].name)) ) {
+                   entry[j] = k ;
+                   break ;
+               }
+          }
+     }
+
+     // es: resolver todos los nombres en una sola pasada por los i-nodos
+     // en: resolve all the names in a single pass over the i-nodes
+     for (int i=0; i<sblock.numInodes; i++)
+     {
+          if (0 == inodes.nameHash[i]) {
+              continue ;
+          }
+          for (int k=inodes.nameHash[i] & mask; NULL != table[k].name; k=(k+1) & mask)
+          {
+               if ( (table[k].hash == inodes.nameHash[i]) && (! strcmp(table[k].name, names[i].name)) ) {
+                   table[k].inodo_id = i ;
+                   break ;
+               }
+          }
+     }
+
+     // es: aplicar las operaciones en orden
+     // en: apply the operations in order
+     ok = 0 ;
+     for (int j=0; j<n; j++)
+     {
+          int k = entry[j] ;
+
+          ops[j].result = -1 ;
+          if (k < 0) {
+              continue ;
+          }
+
+          switch (ops[j].op)
+          {
+              case OP_STAT:
+                   if (table[k].inodo_id >= 0) {
+                       ops[j].size   = inodes.size[table[k].inodo_id] ;
+                       ops[j].type   = inodes.type[table[k].inodo_id] ;
+                       ops[j].result = table[k].inodo_id ;
+                   }
+                   break ;
+
+              case OP_CREAT:
+                   // es: como nanofs_creat, pero el fichero no queda abierto
+                   // en: as nanofs_creat, but the file is not left open
+                   if ( (is_readonly) || (table[k].inodo_id >= 0) ) {
+                       break ;
+                   }
+                   // es: el i-nodo se elige como en nanofs_creat (según los grupos de bloques)
+                   // en: the i-node is chosen as in nanofs_creat (by block groups)
+                   inodo_id = nanofs_ialloc() ;
+                   if (inodo_id < 0) {
+                       break ;
+                   }
+                   nanofs_iname(inodo_id, table[k].name, table[k].hash) ;
+                   inodes_x[inodo_id].position = 0 ;
+                   table[k].inodo_id = ops[j].result = inodo_id ;
+                   break ;
+
+              case OP_UNLINK:
+                   // es: como nanofs_unlink, un fichero abierto no se borra
+                   // en: as nanofs_unlink, an open file is not removed
+                   if ( (is_readonly) || (table[k].inodo_id < 0) || (inodes_x[table[k].inodo_id].is_open) ) {
+                       break ;
+                   }
+                   nanofs_iremove(table[k].inodo_id) ;
+                   table[k].inodo_id = -1 ;
+                   ops[j].result     = 1 ;
+                   break ;
+          }
+
+          if (ops[j].result >= 0) {
+              ok++ ;
+          }
+     }
+
+     free(table) ;
+     return ok ;
+}
+
+int nanofs_read ( int fd, char *buffer, int size )
+{
+     char *b ;
+
+     // es: comprobar parámetros
+     // en: check params
+     if ( (fd < 0) || (fd >= sblock.numInodes) )
+     {
+         return -1 ;
+     }
+
+     // es: no leer más allá del final del fichero
+     // en: do not read beyond the end of file
+     size = min_value(size, (int)inodes.size[fd] - inodes_x[fd].position) ;
+     if (size <= 0) {
+         return 0 ;
+     }
+
+     // es: ficheros con escritura diferida por clústeres
+     // en: files with write-back clusters
+     if (sblock.features & (F_COMPRESS | F_DEDUP)) {
+         return nanofs_cache_read(fd, buffer, size) ;
+     }
+
+     // es: buffers de la reserva para el primer y el último bloque (si son parciales)
+     // en: pool buffers for the first and the last block (if partial)
+     b = bpool_get(2 * sblock.blockSize) ;
+     if (NULL == b) {
+         return -1 ;
+     }
+
+     int readed = 0 ;
+     while (size > readed)
+     {
+         int   ids[BAIO_QUEUE_DEPTH], offsets[BAIO_QUEUE_DEPTH], lengths[BAIO_QUEUE_DEPTH] ;
+         int   blocks[BAIO_QUEUE_DEPTH] ;
+         char *bufs[BAIO_QUEUE_DEPTH], *dsts[BAIO_QUEUE_DEPTH] ;
+         int   n = 0, k = 0, partial = 0, chunk = 0 ;
+
+         // es: referencias de los bloques de esta tanda (el indirecto se lee una sola vez)
+         // en: entries of the blocks of this batch (the indirect one is read only once)
+         int first = inodes_x[fd].position / sblock.blockSize ;
+         int count = (inodes_x[fd].position + size - readed - 1) / sblock.blockSize - first + 1 ;
+         if (nanofs_bmapn(fd, first, min_value(count, BAIO_QUEUE_DEPTH), blocks) < 0) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+
+         // es: preparar hasta BAIO_QUEUE_DEPTH bloques (los completos van directos al buffer del usuario)
+         // en: prepare up to BAIO_QUEUE_DEPTH blocks (full ones go straight into the user buffer)
+         while ( (size > readed + chunk) && (k < BAIO_QUEUE_DEPTH) )
+         {
+             int position_within_block = (inodes_x[fd].position + chunk) % sblock.blockSize ;
+             int to_read  = sblock.blockSize - position_within_block ;
+                 to_read  = (to_read > size - readed - chunk) ? size - readed - chunk : to_read ;
+             int block_id = blocks[k++] ;
+
+             // es: un hueco son ceros
+             // en: a hole is zeros
+             if (BLOCK_NONE == block_id) {
+                 memset(buffer+readed+chunk, 0, to_read) ;
+             }
+             else if (block_id < 0) {
+                 bpool_put(b) ;
+                 return -1 ;
+             }
+             else
+             {
+                 ids[n]     = sblock.firstDataBlock + block_id ;
+                 dsts[n]    = buffer + readed + chunk ;
+                 offsets[n] = position_within_block ;
+                 lengths[n] = to_read ;
+                 bufs[n]    = (to_read == sblock.blockSize) ? dsts[n] : b + (partial++)*sblock.blockSize ;
+                 n++ ;
+             }
+             chunk = chunk + to_read ;
+         }
+
+         // es: leer los bloques a la vez + tomar la porción pedida de los parciales
+         // en: read the blocks at once + get the portion requested from partial ones
+         if ( (n > 0) && (nanofs_bio(0, n, ids, bufs) < 0) ) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+         for (int i=0; i<n; i++)
+         {
+             if (bufs[i] != dsts[i]) {
+                 memmove(dsts[i], bufs[i]+offsets[i], lengths[i]) ;
+             }
+         }
+
+         inodes_x[fd].position = inodes_x[fd].position + chunk ;
+         readed = readed + chunk ;
+     }
+
+     bpool_put(b) ;
+     return readed ;
+}
+
+int nanofs_write_append ( int fd, char *buffer, int n )
+{
+    int ids[WRITE_RUN_BLOCKS] ;
+    int ret = 1 ;
+
+    // es: reservar n bloques (seguidos desde el objetivo del fichero) sin escribirlos a cero
+    // en: allocate n blocks (in a row from the file goal) without zero-filling them
+    for (int i=0; i<n; i++)
+    {
+         ids[i] = nanofs_alloc_nozero(fd) ;
+         if (ids[i] < 0) {
+             ret = -1 ;
+             n = i ;
+         }
+    }
+
+    // es: escribir cada tramo contiguo con una sola petición, directamente desde el buffer del usuario
+    // en: write each contiguous run with a single request, straight from the user buffer
+    for (int i=0, j=0; (ret >= 0) && (i<n); i=j)
+    {
+         for (j=i+1; (j<n) && (ids[j] == ids[j-1] + 1); j++) ;
+         ret = nanofs_bio_range(1, sblock.firstDataBlock + ids[i], j - i, buffer + (size_t)i * sblock.blockSize, sblock.blockSize) ;
+    }
+
+    // es: enlazar los bloques tras escribir los datos (el indirecto se escribe una sola vez)
+    // en: link the blocks after writing the data (the indirect one is written only once)
+    if (ret >= 0) {
+        ret = nanofs_bmap_setn(fd, inodes_x[fd].position / sblock.blockSize, n, ids) ;
+    }
+    if (ret < 0)
+    {
+        for (int i=0; i<n; i++) {
+             nanofs_free(ids[i]) ;
+        }
+        return -1 ;
+    }
+
+    inodes_x[fd].position = inodes_x[fd].position + n * sblock.blockSize ;
+      inodes.size[fd]     = max_value(inodes_x[fd].position, inodes.size[fd]) ;
+
+    return n * sblock.blockSize ;
+}
+
+int nanofs_write ( int fd, char *buffer, int size )
+{
+     char *b ;
+
+     // es: comprobar parámetros
+     // en: check params
+     if ( (fd < 0) || (fd >= sblock.numInodes) )
+     {
+         return -1 ;
+     }
+
+     // es: no se modifica una instantánea
+     // en: a snapshot is not modified
+     if (is_readonly) {
+         return -1 ;
+     }
+
+     // es: nada que escribir
+     // en: nothing to write
+     if (size <= 0) {
+         return 0 ;
+     }
+
+     // es: no escribir más allá del tamaño máximo de fichero
+     // en: do not write beyond the maximum file size
+     size = min_value(size, nanofs_maxsize() - inodes_x[fd].position) ;
+     if (size <= 0) {
+         return -1 ;
+     }
+
+     // es: ficheros con escritura diferida por clústeres
+     // en: files with write-back clusters
+     if (sblock.features & (F_COMPRESS | F_DEDUP)) {
+         return nanofs_cache_write(fd, buffer, size) ;
+     }
+
+     // es: buffer de bloque de la reserva (alineado)
+     // en: block buffer from the pool (aligned)
+     b = bpool_get(sblock.blockSize) ;
+     if (NULL == b) {
+         return -1 ;
+     }
+
+     int written = 0 ;
+     while (size > written)
+     {
+         // es: bloques completos tras el final del fichero: no hay nada que leer ni que copiar
+         // en: full blocks past the end of file: there is nothing to read or to copy
+         int full = (size - written) / sblock.blockSize ;
+         if ( (full > 0) && (0 == inodes_x[fd].position % sblock.blockSize) && (inodes_x[fd].position >= inodes.size[fd]) )
+         {
+             int ret = nanofs_write_append(fd, buffer + written, min_value(full, WRITE_RUN_BLOCKS)) ;
+             if (ret < 0) {
+                 bpool_put(b) ;
+                 return -1 ;
+             }
+             written = written + ret ;
+             continue ;
+         }
+
+         // es: obtener bloque
+         // en: get block
+         int position_within_block = inodes_x[fd].position % sblock.blockSize ;
+         int to_write = sblock.blockSize - position_within_block ;
+             to_write = (to_write > size - written) ? size - written : to_write ;
+
+         int block_id = nanofs_bmap(fd, inodes_x[fd].position) ;
+         if (BLOCK_NONE == block_id) {
+             block_id = nanofs_alloc(fd) ;
+             if (block_id < 0) {
+                 bpool_put(b) ;
+                 return -1 ;
+             }
+             if (nanofs_bmap_set(fd, inodes_x[fd].position / sblock.blockSize, block_id) < 0) {
+                 bpool_put(b) ;
+                 return -1 ;
+             }
+         }
+         if (block_id < 0) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+
+         // es: lee bloque + toma porción pedida por el usuario
+         // en: read block + get portion requested by user
+         if (nanofs_bread(sblock.firstDataBlock+block_id, b) < 0) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+
+         // es: copia en escritura si el bloque está compartido (clon o instantánea)
+         // en: copy-on-write if the block is shared (clone or snapshot)
+         if (r_map[block_id] > 1)
+         {
+             int copy_id = nanofs_alloc_nozero(fd) ;
+             if (copy_id < 0) {
+                 bpool_put(b) ;
+                 return -1 ;
+             }
+             if (nanofs_bmap_set(fd, inodes_x[fd].position / sblock.blockSize, copy_id) < 0) {
+                 nanofs_free(copy_id) ;
+                 bpool_put(b) ;
+                 return -1 ;
+             }
+             nanofs_free(block_id) ;
+             block_id = copy_id ;
+             stats.blocksCopiedOnWrite++ ;
+         }
+
+         memmove(b+position_within_block, buffer+written, to_write) ;
+         if (nanofs_bwrite(sblock.firstDataBlock+block_id, b) < 0) {
+             bpool_put(b) ;
+             return -1 ;
+         }
+
+         inodes_x[fd].position = inodes_x[fd].position + to_write ;
+           inodes.size[fd]     = max_value(inodes_x[fd].position, inodes.size[fd]) ;
+         written = written + to_write ;
+     }
+
+     bpool_put(b) ;
+     return written ;
+}
+
+int nanofs_lseek ( int fd, int offset, int whence )
+{
+     // es: comprobar parámetros
+     // en: check params
+     if ( (fd < 0) || (fd >= sblock.numInodes) )
+     {
+         return -1 ;
+     }
+
+     // es: salta a la posici'on pedida
+     // en: seek to the requested offset
+     switch (whence) 
+     {
+         case SEEK_SET:
+              inodes_x[fd].position = offset ;
+              break ;
+         case SEEK_CUR:
+              inodes_x[fd].position = inodes_x[fd].position + offset ;
+              break ;
+         case SEEK_END:
+              inodes_x[fd].position = inodes.size[fd] + offset ;
+              break ;
+     }
+
+     // es: devolver posici'on resultante
+     // en: return current position
+     return inodes_x[fd].position ;
+}
+
+int nanofs_clone ( char *src_name, char *dst_name )
+{
+     int src_id, dst_id ;
+
+     // es: no se modifica una instantánea
+     // en: a snapshot is not modified
+     if (is_readonly) {
+         return -1 ;
+     }
+
+     // es: el origen debe existir y el destino no
+     // en: source must exist and destination must not
+     src_id = nanofs_namei(src_name) ;
+     if ( (src_id < 0) || (nanofs_namei(dst_name) >= 0) || (strlen(dst_name) > NAME_LENGTH) ) {
+         return -1 ;
+     }
+
+     // es: escribir el clúster pendiente del origen (si está abierto)
+     // en: write back the pending cluster of the source (if open)
+     if (nanofs_cache_flush(src_id) < 0) {
+         return -1 ;
+     }
+
+     // es: el clon ve las escrituras asíncronas ya terminadas
+     // en: the clone sees the asynchronous writes already finished
+     nanofs_async_drain(-1) ;
+
+     // es: compartir el árbol de bloques del origen (solo cambian metadatos)
+     // en: share the source block tree (only metadata changes)
+     if (nanofs_tree_retain(inodes.directBlock[src_id], inodes.indirectBlock[src_id]) < 0) {
+         return -1 ;
+     }
+
+     dst_id = nanofs_ialloc() ;
+     if (dst_id < 0) {
+         nanofs_tree_release(inodes.directBlock[src_id], inodes.indirectBlock[src_id]) ;
+         return -1 ;
+     }
+
+     strcpy(names[dst_id].name, dst_name) ;
+     names[dst_id].hash            = nanofs_namehash(dst_name) ;
+     inodes.nameHash[dst_id]       = names[dst_id].hash ;
+     inodes.type[dst_id]           = inodes.type[src_id] ;
+     inodes.size[dst_id]           = inodes.size[src_id] ;
+     inodes.directBlock[dst_id]    = inodes.directBlock[src_id] ;
+     inodes.indirectBlock[dst_id]  = inodes.indirectBlock[src_id] ;
+
+     return 1 ;
+}
+
+int nanofs_snapshot_create ( void )
+{
+     int snapshot_id ;
+
+     // es: comprobar que está montado en lectura-escritura
+     // en: check it is mounted read-write
+     if ( (0 == is_mounted) || (is_readonly) ) {
+         return -1 ;
+     }
+
+     // es: la instantánea ve las escrituras asíncronas ya terminadas
+     // en: the snapshot sees the asynchronous writes already finished
+     nanofs_async_drain(-1) ;
+
+     // es: buscar un hueco libre
+     // en: search for a free slot
+     for (snapshot_id=0; snapshot_id<sblock.numSnapshots; snapshot_id++) {
+          if (0 == (sblock.snapshotMask & (1 << snapshot_id))) {
+              break ;
+          }
+     }
+     if (snapshot_id >= sblock.numSnapshots) {
+         return -1 ;
+     }
+
+     // es: punto consistente: escribir los clústeres pendientes de los ficheros abiertos
+     // en: consistent point: write back the pending clusters of open files
+     for (int i=0; i<sblock.numInodes; i++) {
+          if (nanofs_cache_flush(i) < 0) {
+              return -1 ;
+          }
+     }
+
+     // es: la instantánea es un árbol más para cada fichero
+     // en: the snapshot is one more tree for each file
+     for (int i=0; i<sblock.numInodes; i++)
+     {
+          if (0 == i_map[i]) {
+              continue ;
+          }
+          if (nanofs_tree_retain(inodes.directBlock[i], inodes.indirectBlock[i]) < 0)
+          {
+              for (int j=0; j<i; j++) {
+                   if (i_map[j]) {
+                       nanofs_tree_release(inodes.directBlock[j], inodes.indirectBlock[j]) ;
+                   }
+              }
+              return -1 ;
+          }
+     }
+
+     // es: copiar la tabla de i-nodos y nombres al hueco
+     // en: copy the i-node and name table into the slot
+     if (nanofs_meta_writeInodes(nanofs_snapshot_block(snapshot_id),
+                                 nanofs_snapshot_block(snapshot_id) + sblock.numInodesBlocks,
+                                 &inodes, names) < 0)
+     {
+         for (int i=0; i<sblock.numInodes; i++) {
+              if (i_map[i]) {
+                  nanofs_tree_release(inodes.directBlock[i], inodes.indirectBlock[i]) ;
+              }
+         }
+         return -1 ;
+     }
+     sblock.snapshotMask |= (1 << snapshot_id) ;
+
+     return snapshot_id ;
+}
+
+int nanofs_snapshot_delete ( int snapshot_id )
+{
+     TypeInodesMem snap_inodes ;
+     TypeNamesDisk snap_names ;
+
+     // es: comprobar parámetros
+     // en: check params
+     if ( (0 == is_mounted) || (is_readonly) ||
+          (snapshot_id < 0) || (snapshot_id >= sblock.numSnapshots) ||
+          (0 == (sblock.snapshotMask & (1 << snapshot_id))) )
+     {
+         return -1 ;
+     }
+
+     // es: esperar a las peticiones asíncronas (como en nanofs_unlink)
+     // en: wait for the asynchronous requests (as in nanofs_unlink)
+     nanofs_async_drain(-1) ;
+
+     // es: leer la tabla de la instantánea y soltar sus árboles de bloques
+     // en: read the snapshot table and release its block trees
+     if (nanofs_meta_readInodes(nanofs_snapshot_block(snapshot_id),
+                                nanofs_snapshot_block(snapshot_id) + sblock.numInodesBlocks,
+                                &snap_inodes, snap_names) < 0) {
+         return -1 ;
+     }
+     for (int i=0; i<sblock.numInodes; i++)
+     {
+          if (0 != snap_inodes.nameHash[i]) {
+              nanofs_tree_release(snap_inodes.directBlock[i], snap_inodes.indirectBlock[i]) ;
+          }
+     }
+     sblock.snapshotMask &= ~(1 << snapshot_id) ;
+
+     return 1 ;
+}
+
+int nanofs_stats ( TypeStats *st )
+{
+     // es: comprobar parámetros
+     // en: check params
+     if (NULL == st) {
+         return -1 ;
+     }
+
+     memmove(st, &stats, sizeof(TypeStats)) ;
+
+     return 1 ;
+}
+
+
+/*
+ * es: Comprobación y reparación sin montar (fsck)
+ * en: Offline check and repair (fsck)
+ *
+ * es: Primero se revisan los i-nodos (mapa, nombre, tipo y tamaño). Después
+ *     varios hilos recorren los árboles de bloques (i-nodos vivos y de las
+ *     instantáneas) contando las referencias a cada bloque de datos, y luego
+ *     cada hilo compara su tramo de bloques con b_map y r_map (con F_CHECKSUM
+ *     también lee los que están en uso y comprueba su suma de control).
+ *     Un bloque indirecto compartido (clones e instantáneas) lo revisa un
+ *     solo hilo, que suma a sus entradas una referencia por cada árbol que lo
+ *     usa. Al reparar, r_map pasa a ser el número de referencias encontradas:
+ *     un bloque perdido se libera y uno asignado dos veces queda compartido,
+ *     así que la copia en escritura lo separa cuando se modifique. Si el área
+ *     de sumas de control está dañada, se avisa y al reparar se recalcula.
+ * en: First the i-nodes are checked (map, name, type and size). Then several
+ *     threads walk the block trees (live and snapshot i-nodes) counting the
+ *     references to each data block, and after that each thread compares its
+ *     range of blocks with b_map and r_map (with F_CHECKSUM it also reads the
+ *     ones in use and checks their checksum).
+ *     A shared indirect block (clones and snapshots) is checked by a single
+ *     thread, which adds to its entries one reference per tree using it.
+ *     On repair, r_map becomes the number of references found: a leaked
+ *     block is freed and a doubly allocated one is left shared, so that
+ *     copy-on-write splits it when it is modified. If the checksum area is
+ *     damaged it is reported, and rebuilt on repair.
+ */
+
+typedef struct {
+    int32_t *direct ;         // es: punteros del i-nodo (en inodes o en una instantánea)
+    int32_t *indirect ;       // en: i-node pointers (in inodes or in a snapshot)
+    int      slot ;           // es: -1: i-nodo vivo, s: hueco de instantánea s
+                              // en: -1: live i-node, s: snapshot slot s
+} TypeFsckTree ;
+
+struct fsck_state {
+    int            repair ;
+    int            num_threads ;
+    int            num_trees ;
+    TypeFsckTree  *trees ;
+    uint32_t      *refs ;     // es: referencias encontradas por bloque de datos
+                              // en: references found per data block
+    uint32_t      *owners ;   // es: árboles que usan cada bloque como indirecto
+                              // en: trees using each block as their indirect one
+    int32_t       *indirects ; // es: bloques indirectos distintos (cada uno para un solo hilo)
+    int            num_indirects ; // en: distinct indirect blocks (each one for a single thread)
+    int            crc_bad ;  // es: área de sumas de control dañada
+                              // en: damaged checksum area
+    int            snap_dirty[NUM_SNAPSHOTS] ;
+    pthread_mutex_t lock ;    // es: para reescribir bloques indirectos
+                              // en: to rewrite indirect blocks
+} ;
+
+typedef struct {
+    struct fsck_state *st ;
+    int            id ;
+    int            result ;
+    TypeFsckReport report ;
+} TypeFsckWorker ;
+
+int nanofs_fsck_inodes ( int repair, TypeFsckReport *report )
+{
+    int used, named, bad ;
+
+    for (int i=0; i<sblock.numInodes; i++)
+    {
+         names[i].name[NAME_LENGTH] = '\0' ;
+         used  = (0 != i_map[i]) ;
+         named = (0 != names[i].hash) ;
+         report->inodesUsed += used ;
+
+         // es: i-nodo sin nombre: no se puede abrir, se libera (sus bloques quedan perdidos)
+         // en: i-node without a name: it cannot be opened, it is freed (its blocks are leaked)
+         if ( (! named) && ( (used) || (BLOCK_NONE != inodes.directBlock[i]) || (BLOCK_NONE != inodes.indirectBlock[i]) ) )
+         {
+             report->badInodes++ ;
+             if (repair) {
+                 nanofs_iclear(i) ;
+                 i_map[i] = 0 ;
+                 report->repaired++ ;
+             }
+             continue ;
+         }
+         if (! named) {
+             continue ;
+         }
+
+         // es: con nombre: debe estar en el mapa, con su hash, un tipo válido y un tamaño posible
+         // en: named: it must be in the map, with its hash, a valid type and a possible size
+         bad = (! used) ||
+               (names[i].hash != nanofs_namehash(names[i].name)) ||
+               ( (T_FILE != inodes.type[i]) && (T_DIRECTORY != inodes.type[i]) ) ||
+               (inodes.size[i] > nanofs_maxsize()) ;
+         if (! bad) {
+             continue ;
+         }
+         report->badInodes++ ;
+         if (repair)
+         {
+             i_map[i]          = 1 ;
+             names[i].hash     = nanofs_namehash(names[i].name) ;
+             inodes.nameHash[i] = names[i].hash ;
+             if ( (T_FILE != inodes.type[i]) && (T_DIRECTORY != inodes.type[i]) ) {
+                 inodes.type[i] = T_FILE ;
+             }
+             if (inodes.size[i] > nanofs_maxsize()) {
+                 inodes.size[i] = nanofs_maxsize() ;
+             }
+             report->repaired++ ;
+         }
+    }
+
+    return 1 ;
+}
+
+int nanofs_fsck_pointer ( TypeFsckWorker *w, int32_t *block_id, int allow_zcluster, uint32_t nrefs )
+{
+    // es: un bloque de datos válido cuenta nrefs referencias (una por árbol)
+    // en: a valid data block counts nrefs references (one per tree)
+    if ( (*block_id >= 0) && (*block_id < sblock.numDataBlocks) ) {
+        __atomic_fetch_add(&(w->st->refs[*block_id]), nrefs, __ATOMIC_RELAXED) ;
+        return 0 ;
+    }
+    if ( (BLOCK_NONE == *block_id) || ( (allow_zcluster) && (BLOCK_ZCLUSTER == *block_id) ) ) {
+        return 0 ;
+    }
+
+    // es: fuera de rango: se pierde ese bloque lógico (queda un hueco)
+    // en: out of range: that logical block is lost (a hole is left)
+    w->report.badPointers++ ;
+    if (w->st->repair) {
+        *block_id = BLOCK_NONE ;
+        w->report.repaired++ ;
+        return 1 ;
+    }
+
+    return 0 ;
+}
+
+int nanofs_fsck_tree ( TypeFsckWorker *w, TypeFsckTree *t )
+{
+    int changed = 0 ;
+
+    changed += nanofs_fsck_pointer(w, t->direct, 0, 1) ;
+    changed += nanofs_fsck_pointer(w, t->indirect, 0, 1) ;
+    if ( (changed > 0) && (t->slot >= 0) ) {
+        w->st->snap_dirty[t->slot] = 1 ;
+    }
+    if (*(t->indirect) < 0) {
+        return 1 ;
+    }
+
+    // es: el primer árbol que usa el bloque indirecto lo apunta para revisarlo después
+    // en: the first tree using the indirect block records it to be checked later
+    if (0 == __atomic_fetch_add(&(w->st->owners[*(t->indirect)]), 1, __ATOMIC_RELAXED)) {
+        w->st->indirects[__atomic_fetch_add(&(w->st->num_indirects), 1, __ATOMIC_RELAXED)] = *(t->indirect) ;
+    }
+
+    return 1 ;
+}
+
+void *nanofs_fsck_trees ( void *arg )
+{
+    TypeFsckWorker *w = arg ;
+
+    // es: árboles repartidos en turno rotatorio
+    // en: trees spread round-robin
+    for (int t=w->id; (t < w->st->num_trees) && (w->result >= 0); t+=w->st->num_threads) {
+         w->result = nanofs_fsck_tree(w, &(w->st->trees[t])) ;
+    }
+
+    return NULL ;
+}
+
+int nanofs_fsck_indirect ( TypeFsckWorker *w, int indirect_id, int32_t *b )
+{
+    int changed = 0 ;
+
+    // es: entradas del bloque indirecto (si se arregla alguna se reescribe)
+    // en: indirect block entries (if any is fixed it is written back)
+    if (bread(device_name, sblock.firstDataBlock + indirect_id, b) < 0) {
+        return -1 ;
+    }
+    for (int i=0; i<sblock.blockSize/4; i++) {
+         changed += nanofs_fsck_pointer(w, &(b[i]), 1, w->st->owners[indirect_id]) ;
+    }
+    if (changed > 0)
+    {
+        pthread_mutex_lock(&(w->st->lock)) ;
+        changed = nanofs_bwrite(sblock.firstDataBlock + indirect_id, b) ;
+        pthread_mutex_unlock(&(w->st->lock)) ;
+        if (changed < 0) {
+            return -1 ;
+        }
+    }
+
+    return 1 ;
+}
+
+void *nanofs_fsck_indirects ( void *arg )
+{
+    TypeFsckWorker *w = arg ;
+    int32_t *b ;
+
+    b = bpool_get(sblock.blockSize) ;
+    if (NULL == b) {
+        w->result = -1 ;
+        return NULL ;
+    }
+
+    // es: cada bloque indirecto distinto lo revisa un solo hilo (turno rotatorio)
+    // en: each distinct indirect block is checked by a single thread (round-robin)
+    for (int i=w->id; (i < w->st->num_indirects) && (w->result >= 0); i+=w->st->num_threads) {
+         w->result = nanofs_fsck_indirect(w, w->st->indirects[i], b) ;
+    }
+
+    bpool_put(b) ;
+    return NULL ;
+}
+
+int nanofs_fsck_crc ( TypeFsckWorker *w, int first, int n, char *b )
+{
+    // es: un tramo de bloques en uso en una sola petición
+    // en: a run of blocks in use in a single request
+    if (breadn(device_name, sblock.firstDataBlock + first, n, b) < 0) {
+        return -1 ;
+    }
+    for (int i=0; i<n; i++)
+    {
+         uint32_t crc = crc32c(0, b + (size_t)i * sblock.blockSize, sblock.blockSize) ;
+
+         // es: con el área dañada se recalcula (solo al reparar)
+         // en: with a damaged area it is rebuilt (only on repair)
+         if (w->st->crc_bad) {
+             crc_map[sblock.firstDataBlock + first + i] = crc ;
+         }
+         else if (crc_map[sblock.firstDataBlock + first + i] != crc) {
+             w->report.checksumErrors++ ;
+         }
+    }
+
+    return 1 ;
+}
+
+void *nanofs_fsck_blocks ( void *arg )
+{
+    TypeFsckWorker *w = arg ;
+    uint32_t *refs = w->st->refs ;
+    char *b = NULL ;
+    int   first, last, run = 1 ;
+
+    // es: tramo de bloques de este hilo
+    // en: range of blocks of this thread
+    first = (int)((long)sblock.numDataBlocks *  w->id      / w->st->num_threads) ;
+    last  = (int)((long)sblock.numDataBlocks * (w->id + 1) / w->st->num_threads) ;
+    if ( (NULL != crc_map) && ( (! w->st->crc_bad) || (w->st->repair) ) )
+    {
+        b = bpool_get(FSCK_RUN_BLOCKS * sblock.blockSize) ;
+        if (NULL == b) {
+            w->result = -1 ;
+            return NULL ;
+        }
+    }
+
+    for (int i=first; i<last; i++)
+    {
+         // es: menos referencias que r_map: perdido; más: asignado dos veces
+         // en: fewer references than r_map: leaked; more: doubly allocated
+         if ( (refs[i] < r_map[i]) || ( (0 != b_map[i]) && (0 == refs[i]) ) ) {
+             w->report.leakedBlocks++ ;
+         }
+         else if ( (refs[i] > r_map[i]) || ( (0 == b_map[i]) && (0 != refs[i]) ) ) {
+             w->report.doubleBlocks++ ;
+         }
+         if ( (w->st->repair) && ( (refs[i] != r_map[i]) || (b_map[i] != (0 != refs[i])) ) )
+         {
+             r_map[i] = refs[i] ;
+             b_map[i] = (0 != refs[i]) ;
+             if (0 == refs[i]) {
+                 c_map[i] = 0 ;
+             }
+             w->report.repaired++ ;
+         }
+         w->report.blocksUsed += (0 != refs[i]) ;
+    }
+
+    // es: sumas de control de los bloques en uso, por tramos consecutivos
+    // en: checksums of the blocks in use, by consecutive runs
+    for (int i=first; (NULL != b) && (i<last) && (w->result >= 0); i+=run)
+    {
+         run = 0 ;
+         while ( (i + run < last) && (run < FSCK_RUN_BLOCKS) && (0 != refs[i + run]) ) {
+             run++ ;
+         }
+         if (run > 0) {
+             w->result = nanofs_fsck_crc(w, i, run, b) ;
+         }
+         else {
+             run = 1 ;
+         }
+    }
+
+    bpool_put(b) ;
+    return NULL ;
+}
+
+int nanofs_fsck_run ( struct fsck_state *st, void *(*func)(void *), TypeFsckWorker *workers )
+{
+    pthread_t threads[FSCK_THREADS_MAX] ;
+    int started[FSCK_THREADS_MAX] ;
+    int ret = 1 ;
+
+    // es: una pasada con num_threads hilos (si no se puede crear uno, su parte se hace aquí)
+    // en: one pass with num_threads threads (if one cannot be created, its part is done here)
+    for (int i=0; i<st->num_threads; i++)
+    {
+         started[i] = (0 == pthread_create(&(threads[i]), NULL, func, &(workers[i]))) ;
+         if (! started[i]) {
+             func(&(workers[i])) ;
+         }
+    }
+    for (int i=0; i<st->num_threads; i++)
+    {
+         if (started[i]) {
+             pthread_join(threads[i], NULL) ;
+         }
+         if (workers[i].result < 0) {
+             ret = -1 ;
+         }
+    }
+
+    return ret ;
+}
+
+int nanofs_fsck ( int repair, int num_threads, TypeFsckReport *report )
+{
+    struct fsck_state st ;
+    TypeFsckWorker    workers[FSCK_THREADS_MAX] ;
+    TypeInodesMem     snap_inodes[NUM_SNAPSHOTS] ;
+    TypeNamesDisk     snap_names[NUM_SNAPSHOTS] ;
+    uint32_t         *crc_area ;
+    int ret, problems ;
+
+    // es: sin montar
+    // en: not mounted
+    if ( (1 == is_mounted) || (NULL == report) ) {
+        return -1 ;
+    }
+    memset(report, 0, sizeof(TypeFsckReport)) ;
+    memset(&st, 0, sizeof(st)) ;
+    st.repair      = repair ;
+    st.num_threads = (num_threads <= 0) ? FSCK_THREADS : min_value(num_threads, FSCK_THREADS_MAX) ;
+
+    // es: carga tolerante: un área de sumas de control dañada no impide la comprobación
+    // en: tolerant load: a damaged checksum area does not prevent the check
+    ret = nanofs_meta_readFromDisk(1) ;
+    if (ret < 0) {
+        nanofs_meta_freeMaps() ;
+        bclose(device_name) ;
+        return -1 ;
+    }
+    st.crc_bad = (0 == ret) ;
+    if (st.crc_bad) {
+        report->checksumErrors++ ;
+        report->repaired += repair ;
+    }
+
+    // es: i-nodos vivos (se arreglan antes de contar sus bloques)
+    // en: live i-nodes (they are fixed before counting their blocks)
+    nanofs_fsck_inodes(repair, report) ;
+
+    // es: árboles de bloques: i-nodos vivos con nombre y los de cada instantánea
+    // en: block trees: named live i-nodes and the ones of each snapshot
+    ret       = 1 ;
+    st.trees  = malloc((NUM_SNAPSHOTS + 1) * sblock.numInodes * sizeof(TypeFsckTree)) ;
+    st.refs   = calloc(sblock.numDataBlocks, sizeof(uint32_t)) ;
+    st.owners = calloc(sblock.numDataBlocks, sizeof(uint32_t)) ;
+    st.indirects = malloc((NUM_SNAPSHOTS + 1) * sblock.numInodes * sizeof(int32_t)) ;
+    if ( (NULL == st.trees) || (NULL == st.refs) || (NULL == st.owners) || (NULL == st.indirects) ) {
+        ret = -1 ;
+    }
+    for (int i=0; (ret >= 0) && (i<sblock.numInodes); i++)
+    {
+         if (0 != names[i].hash) {
+             st.trees[st.num_trees++] = (TypeFsckTree){ &(inodes.directBlock[i]), &(inodes.indirectBlock[i]), -1 } ;
+         }
+    }
+
+    // es: con el área dañada las instantáneas se leen sin comprobar sus sumas
+    // en: with a damaged area the snapshots are read without checking their checksums
+    crc_area = crc_map ;
+    if (st.crc_bad) {
+        crc_map = NULL ;
+    }
+    for (int s=0; (ret >= 0) && (s<sblock.numSnapshots); s++)
+    {
+         if (0 == (sblock.snapshotMask & (1 << s))) {
+             continue ;
+         }
+         if (nanofs_meta_readInodes(nanofs_snapshot_block(s), nanofs_snapshot_block(s) + sblock.numInodesBlocks,
+                                    &(snap_inodes[s]), snap_names[s]) < 0) {
+             ret = -1 ;
+             break ;
+         }
+         // es: al reparar el área se reescriben para recalcular sus sumas
+         // en: when the area is repaired they are rewritten to recompute their checksums
+         st.snap_dirty[s] = st.crc_bad ;
+         for (int i=0; i<sblock.numInodes; i++)
+         {
+              if (0 != snap_inodes[s].nameHash[i]) {
+                  st.trees[st.num_trees++] = (TypeFsckTree){ &(snap_inodes[s].directBlock[i]), &(snap_inodes[s].indirectBlock[i]), s } ;
+              }
+         }
+    }
+    crc_map = crc_area ;
+
+    // es: contar referencias (árboles y después bloques indirectos) y comparar con los mapas, en paralelo
+    // en: count references (trees and then indirect blocks) and compare with the maps, in parallel
+    pthread_mutex_init(&(st.lock), NULL) ;
+    for (int i=0; i<st.num_threads; i++)
+    {
+         memset(&(workers[i]), 0, sizeof(TypeFsckWorker)) ;
+         workers[i].st = &st ;
+         workers[i].id = i ;
+    }
+    if (ret >= 0) {
+        ret = nanofs_fsck_run(&st, nanofs_fsck_trees, workers) ;
+    }
+    if (ret >= 0) {
+        ret = nanofs_fsck_run(&st, nanofs_fsck_indirects, workers) ;
+    }
+    if (ret >= 0) {
+        ret = nanofs_fsck_run(&st, nanofs_fsck_blocks, workers) ;
+    }
+    pthread_mutex_destroy(&(st.lock)) ;
+
+    for (int i=0; i<st.num_threads; i++)
+    {
+         report->blocksUsed     += workers[i].report.blocksUsed ;
+         report->badPointers    += workers[i].report.badPointers ;
+         report->leakedBlocks   += workers[i].report.leakedBlocks ;
+         report->doubleBlocks   += workers[i].report.doubleBlocks ;
+         report->checksumErrors += workers[i].report.checksumErrors ;
+         report->repaired       += workers[i].report.repaired ;
+    }
+    problems = report->badInodes + report->badPointers + report->leakedBlocks +
+               report->doubleBlocks + report->checksumErrors ;
+
+    // es: guardar lo reparado (instantáneas cambiadas, mapas, i-nodos y sumas de control)
+    // en: store what was repaired (changed snapshots, maps, i-nodes and checksums)
+    if ( (ret >= 0) && (repair) && (report->repaired > 0) )
+    {
+        for (int s=0; (ret >= 0) && (s<sblock.numSnapshots); s++)
+        {
+             if (st.snap_dirty[s]) {
+                 ret = nanofs_meta_writeInodes(nanofs_snapshot_block(s), nanofs_snapshot_block(s) + sblock.numInodesBlocks,
+                                               &(snap_inodes[s]), snap_names[s]) ;
+             }
+        }
+        if (ret >= 0) {
+            ret = nanofs_meta_writeToDisk() ;
+        }
+    }
+
+    free(st.trees) ;
+    free(st.refs) ;
+    free(st.owners) ;
+    free(st.indirects) ;
+    nanofs_meta_freeMaps() ;
+    bclose(device_name) ;
+
+    return (ret < 0) ? -1 : problems ;
+}
@@ -24,6 +24,8 @@
 
 
 #include "block.h"
+#include "crc32c.h"
+#include "lz.h"
 
 
 /*
@@ -32,52 +34,129 @@
  */
 
 #define NUM_INODES         10
-#define NUM_DATA_BLOCKS    20
+
+#define NANOFS_MAGIC       0x12345
+#define NANOFS_VERSION     9
+
+#define NAME_LENGTH        59
+#define CLUSTER_BLOCKS     4
+#define NUM_SNAPSHOTS      8
 
 #define T_FILE       1
 #define T_DIRECTORY  2
 
+#define FSCK_THREADS      4   /* Hilos de nanofs_fsck por defecto / Default nanofs_fsck threads */
+#define FSCK_THREADS_MAX  64
+#define FSCK_RUN_BLOCKS   64   /* Bloques por lectura al comprobar sumas / Blocks per read when checking checksums */
+
+#define WRITE_RUN_BLOCKS  256  /* Bloques por tanda al escribir tras el final / Blocks per batch when appending */
+#define ASYNC_SLOTS       BAIO_QUEUE_DEPTH  /* Bloques en curso de las peticiones asíncronas */
+                                            /* Blocks in flight of the asynchronous requests */
+
+#define OP_CREAT     1        /* Operaciones de nanofs_batch / nanofs_batch operations */
+#define OP_UNLINK    2
+#define OP_STAT      3
+
+#define F_CHECKSUM   0x0001   /* CRC32C por bloque / per-block CRC32C */
+#define F_COMPRESS   0x0002   /* Compresión LZ por clústeres / LZ compression by clusters */
+#define F_DEDUP      0x0004   /* Deduplicación de bloques / Block deduplication */
+
+#define BLOCK_NONE      (-5)  /* Sin bloque asignado / No block allocated */
+#define BLOCK_ZCLUSTER  (-6)  /* Parte de un clúster comprimido / Part of a compressed cluster */
+
 
 // Superblock
 typedef struct {
     uint32_t numMagic;	          /* Número mágico del superbloque (por ejemplo 0x12345) */
                                   /* Superblock magic number: 0x12345 */
+    uint32_t version;             /* Versión del formato en disco (NANOFS_VERSION) */
+                                  /* On-disk format version (NANOFS_VERSION) */
+    uint32_t blockSize;           /* Tamaño de bloque en bytes (potencia de 2) */
+                                  /* Block size in bytes (power of 2) */
+    uint32_t features;            /* Funcionalidades opcionales (F_CHECKSUM, ...) */
+                                  /* Optional features (F_CHECKSUM, ...) */
+    uint32_t clusterBlocks;       /* Bloques por clúster (1 sin F_COMPRESS) */
+                                  /* Blocks per cluster (1 without F_COMPRESS) */
     uint32_t numInodes; 	  /* Número de inodes en el dispositivo */
                                   /* Number of inodes in the device */
     uint32_t inodesPerBlock;      /* Número de inodos por bloque */
                                   /* Number of inodos per blocks */
     uint32_t numInodesBlocks;     /* Número de bloques de inodos en el disp. */
                                   /* Number of inodos blocks in the device */
+    uint32_t namesPerBlock;       /* Número de nombres por bloque */
+                                  /* Number of names per block */
+    uint32_t numNamesBlocks;      /* Número de bloques de nombres en el disp. */
+                                  /* Number of name blocks in the device */
     uint32_t numDataBlocks;       /* Número de bloques de datos en el disp. */
                                   /* Number of data blocks in the device */
+    uint32_t numMapsBlocks;       /* Número de bloques de mapas */
+                                  /* Number of map blocks */
     uint32_t firstMapsBlock;      /* Identificador del bloque donde se guarda los maps */
                                   /* Block id. where maps are stored */
     uint32_t firstInodeBlock;	  /* Identificador del bloque donde se empiezan a guardar los inodos */
                                   /* Block id. where first inodes are stored */
+    uint32_t firstNamesBlock;     /* Identificador del bloque donde se empiezan a guardar los nombres */
+                                  /* Block id. where first names are stored */
+    uint32_t numSnapshots;        /* Número de huecos para instantáneas */
+                                  /* Number of snapshot slots */
+    uint32_t snapshotMask;        /* Huecos de instantáneas en uso (bit s: hueco s) */
+                                  /* Snapshot slots in use (bit s: slot s) */
+    uint32_t firstSnapshotBlock;  /* Identificador del bloque donde empiezan las instantáneas (i-nodos + nombres) */
+                                  /* Block id. where snapshots (i-nodes + names) start */
+    uint32_t numCrcBlocks;        /* Número de bloques de sumas de control (0 sin F_CHECKSUM) */
+                                  /* Number of checksum blocks (0 without F_CHECKSUM) */
+    uint32_t firstCrcBlock;       /* Identificador del bloque donde se empiezan a guardar las sumas de control */
+                                  /* Block id. where first checksums are stored */
     uint32_t firstDataBlock;      /* 1º bloque de disco para datos tras metadatos */
                                   /* Block id. of the first data block */
-    uint32_t sizeDevice;	  /* Tamaño total del disp. (en bytes) */
-                                  /* Total size of the device in bytes */
+    uint32_t sizeDevice;	  /* Tamaño total del disp. (en bloques) */
+                                  /* Total size of the device in blocks */
+    uint32_t groupBlocks;         /* Bloques de datos por grupo */
+                                  /* Data blocks per group */
+    uint32_t numGroups;           /* Número de grupos (cada uno con su parte de i-nodos y de b_map) */
+                                  /* Number of groups (each one with its share of i-nodes and b_map) */
+    uint32_t crcChecksums;        /* CRC32C del área de sumas de control (0 sin F_CHECKSUM) */
+                                  /* CRC32C of the checksum area (0 without F_CHECKSUM) */
+    uint32_t crcSuperblock;       /* CRC32C del superbloque (con este campo a cero) */
+                                  /* CRC32C of the superblock (with this field set to zero) */
 } TypeSuperblock ;
 
 
-// Inodes
+// Inodes (16 bytes: 4 por línea de caché / 4 per cache line)
 typedef struct {
-    uint32_t type;	               /* T_FILE o T_DIRECTORY */
-	                               /* T_FILE or T_DIRECTORY */
-    char name[50+1];	               /* Nombre del fichero/directorio asociado (termina en cero) */
-	                               /* Name of the associated file/directory (end with '\0')*/
-    uint16_t inodesInDir[NUM_INODES];  /* si (type == T_DIR) -> lista de los inodes del directorio */
-	                               /* if (type == T_DIR) -> list of the inodes in directory */
     uint32_t size;	               /* Tamaño actual del fichero en bytes */
 	                               /* Size in bytes */
-     int16_t directBlock[1];           /* Número del bloque directo */
+    uint16_t type;	               /* T_FILE o T_DIRECTORY */
+	                               /* T_FILE or T_DIRECTORY */
+    uint16_t reserved;                 /* Reservado (alineamiento) */
+	                               /* Reserved (alignment) */
+     int32_t directBlock[1];           /* Número del bloque directo */
 	                               /* Number of the direct block */
-     int16_t indirectBlock;	       /* Número del bloque indirecto */
+     int32_t indirectBlock;	       /* Número del bloque indirecto */
 	                               /* Number of the indirect block */
 } TypeInodeDisk;
 
-typedef TypeInodeDisk TypeInodesDisk[NUM_INODES] ;
+
+// Names (64 bytes: 1 línea de caché / 1 cache line)
+typedef struct {
+    uint32_t hash;                     /* Hash del nombre (0 si está libre) */
+                                       /* Hash of the name (0 if free) */
+    char name[NAME_LENGTH+1];          /* Nombre del fichero/directorio asociado (termina en cero) */
+	                               /* Name of the associated file/directory (end with '\0')*/
+} TypeNameDisk;
+
+typedef TypeNameDisk TypeNamesDisk[NUM_INODES] ;
+
+
+// es: i-nodos en memoria: los campos más usados como estructura de arrays
+// en: in-memory i-nodes: hot fields laid out as struct-of-arrays
+typedef struct {
+    uint32_t size          [NUM_INODES] ;
+    uint16_t type          [NUM_INODES] ;
+    uint32_t nameHash      [NUM_INODES] ;
+     int32_t directBlock   [NUM_INODES] ;
+     int32_t indirectBlock [NUM_INODES] ;
+} TypeInodesMem ;
 
 
 // inode map
@@ -85,9 +164,108 @@ typedef char TypeInodeMap[NUM_INODES] ;  /* 100…0 (usado: i_map[x]=1 | libre:
                                          /* 100…0 (used:  i_map[x]=1 | free:  i_map[x]=0) */
 
 
+// es: mapas de bloques de datos: una entrada por bloque (numDataBlocks entradas, se reservan al montar)
+// en: data block maps: one entry per block (numDataBlocks entries, allocated on mount)
+
 // data block map
-typedef char TypeBlockMap[NUM_DATA_BLOCKS] ;  /* 000…0 (usado: b_map[x]=1 | libre: b_map[x]=0) */
-                                              /* 000…0 (used:  b_map[x]=1 | free:  b_map[x]=0) */
+typedef char TypeBlockMap ;  /* 000…0 (usado: b_map[x]=1 | libre: b_map[x]=0) */
+                             /* 000…0 (used:  b_map[x]=1 | free:  b_map[x]=0) */
+
+
+// compressed cluster map
+typedef uint32_t TypeClusterMap ;  /* c_map[x]: bytes del clúster comprimido que empieza en x (0: sin comprimir) */
+                                   /* c_map[x]: bytes of the compressed cluster starting at x (0: not compressed) */
+
+
+// data block reference counts
+typedef uint32_t TypeRefMap ;  /* r_map[x]: nº de referencias al bloque x (0: libre) */
+                               /* r_map[x]: number of references to block x (0: free) */
+
+
+// data block fingerprints (F_DEDUP)
+typedef uint64_t TypeFingerprintMap ;  /* f_map[x]: huella del contenido del bloque x (0: ninguna) */
+                                       /* f_map[x]: fingerprint of the contents of block x (0: none) */
+
+
+// mkfs options
+typedef struct {
+    uint32_t features;            /* F_CHECKSUM | ... */
+    uint32_t blockSize;           /* Tamaño de bloque (0: BLOCK_SIZE) */
+                                  /* Block size (0: BLOCK_SIZE) */
+    uint32_t numSnapshots;        /* Huecos para instantáneas (0..NUM_SNAPSHOTS) */
+                                  /* Snapshot slots (0..NUM_SNAPSHOTS) */
+    uint32_t groupBlocks;         /* Bloques de datos por grupo (0: 8*blockSize) */
+                                  /* Data blocks per group (0: 8*blockSize) */
+} TypeMkfsOptions ;
+
+
+// statistics
+typedef struct {
+    uint64_t blocksRead;          /* Bloques leídos */
+                                  /* Blocks read */
+    uint64_t blocksWritten;       /* Bloques escritos */
+                                  /* Blocks written */
+    uint64_t checksumErrors;      /* Bloques con suma de control incorrecta */
+                                  /* Blocks with a wrong checksum */
+    uint64_t clustersCompressed;  /* Clústeres escritos comprimidos */
+                                  /* Clusters written compressed */
+    uint64_t clustersRaw;         /* Clústeres escritos sin comprimir (no compensaba) */
+                                  /* Clusters written uncompressed (not worth it) */
+    uint64_t blocksDeduplicated;  /* Bloques no escritos por tener ya una copia idéntica */
+                                  /* Blocks not written because an identical copy exists */
+    uint64_t blocksCopiedOnWrite; /* Bloques compartidos copiados al modificarse */
+                                  /* Shared blocks copied when modified */
+} TypeStats ;
+
+
+// batch operation
+typedef struct {
+    int      op;                  /* OP_CREAT, OP_UNLINK o OP_STAT */
+                                  /* OP_CREAT, OP_UNLINK or OP_STAT */
+    char    *name;
+    int      result;              /* Como la llamada suelta (creat/stat: i-nodo, unlink: 1) o -1 */
+                                  /* As the single call (creat/stat: i-node, unlink: 1) or -1 */
+    uint32_t size;                /* OP_STAT: tamaño en bytes / size in bytes */
+    uint16_t type;                /* OP_STAT: T_FILE o T_DIRECTORY / T_FILE or T_DIRECTORY */
+} TypeBatchOp ;
+
+
+// fsck report
+typedef struct {
+    uint32_t inodesUsed;          /* I-nodos en uso / I-nodes in use */
+    uint32_t blocksUsed;          /* Bloques de datos alcanzables / Reachable data blocks */
+    uint32_t badInodes;           /* I-nodos incoherentes (mapa, nombre, tipo o tamaño) */
+                                  /* Inconsistent i-nodes (map, name, type or size) */
+    uint32_t badPointers;         /* Punteros a bloques fuera de rango */
+                                  /* Out of range block pointers */
+    uint32_t leakedBlocks;        /* Bloques con menos referencias que r_map (perdidos) */
+                                  /* Blocks with fewer references than r_map (leaked) */
+    uint32_t doubleBlocks;        /* Bloques con más referencias que r_map (asignados dos veces) */
+                                  /* Blocks with more references than r_map (doubly allocated) */
+    uint32_t checksumErrors;      /* Bloques en uso con suma de control incorrecta (no se reparan), */
+                                  /* más uno si el área de sumas está dañada (se recalcula) */
+                                  /* Blocks in use with a wrong checksum (not repaired), */
+                                  /* plus one if the checksum area is damaged (it is rebuilt) */
+    uint32_t repaired;            /* Problemas reparados / Problems repaired */
+} TypeFsckReport ;
+
+
+// asynchronous file request
+typedef struct file_request {
+    int   fd ;
+    char *buffer ;
+    int   size ;
+    int   offset ;                /* Posición (-1: la actual del fichero, que avanza) */
+                                  /* Position (-1: the current one of the file, which moves forward) */
+    void (*callback) ( struct file_request *request ) ;  /* Opcional / Optional */
+    void *user_data ;
+    int   is_write ;              /* Lo pone nanofs_read_async/nanofs_write_async */
+                                  /* Set by nanofs_read_async/nanofs_write_async */
+    int   result ;                /* Bytes leídos/escritos o -1 (al completarse) */
+                                  /* Bytes read/written or -1 (on completion) */
+    int   done ;                  /* 0: en curso, 1: completada / 0: in flight, 1: completed */
+    struct file_request *next ;   /* Interno / Internal */
+} TypeFileRequest ;
 
 
 /*
@@ -95,7 +273,11 @@ typedef char TypeBlockMap[NUM_DATA_BLOCKS] ;  /* 000…0 (usado: b_map[x]=1 | li
  *  en: (2) Interface
  */
 
-int nanofs_mkfs   ( int dev_size ) ;
+int nanofs_mkfs   ( int dev_size ) ;  /* dev_size: bloques / blocks */
+int nanofs_mkfs_opts ( int dev_size, TypeMkfsOptions *options ) ;
+
+int nanofs_setdev ( char *devname ) ;  /* "[direct:]path", "unix:path", "tcp:host:port" o/or "stripe:..." */
+                                       /* (DISK por defecto / by default) */
 
 int nanofs_mount  ( void ) ;
 int nanofs_umount ( void ) ;
@@ -110,6 +292,35 @@ int nanofs_read   ( int fd, char *buffer, int size ) ;
 int nanofs_write  ( int fd, char *buffer, int size ) ;
 int nanofs_lseek  ( int fd, int offset, int whence ) ;
 
+int nanofs_clone  ( char *src_name, char *dst_name ) ;
+
+int nanofs_batch  ( TypeBatchOp *ops, int n ) ;  /* Operaciones con éxito / Successful operations */
+int nanofs_readdir ( int *position, char *name ) ;  /* 1: nombre / name, 0: fin / end (*position=0 al empezar / to start) */
+
+int nanofs_snapshot_create ( void ) ;
+int nanofs_snapshot_delete ( int snapshot_id ) ;
+int nanofs_mount_snapshot  ( int snapshot_id ) ;
+
+int nanofs_stats  ( TypeStats *stats ) ;
+
+int nanofs_fsck   ( int repair, int num_threads, TypeFsckReport *report ) ;  /* Sin montar / Not mounted */
+                                                                               /* Problemas encontrados / Problems found */
+
+// es: peticiones asíncronas: se reparten en bloques que van a la vez por baio (las de un mismo
+//     fichero que se solapan, en orden de envío) y avanzan al llamar a poll/wait en el mismo hilo;
+//     el rango de una escritura en curso no se lee con nanofs_read hasta que termine (nanofs_close,
+//     nanofs_unlink, nanofs_clone, las instantáneas y nanofs_umount esperan a las que haya)
+// en: asynchronous requests: they are split into blocks that go through baio at the same time (the
+//     overlapping ones of the same file, in submission order) and move on when poll/wait is called
+//     in the same thread; the range of a write in flight is not read with nanofs_read until it
+//     finishes (nanofs_close, nanofs_unlink, nanofs_clone, snapshots and nanofs_umount wait for them)
+int nanofs_read_async  ( TypeFileRequest *request ) ;
+int nanofs_write_async ( TypeFileRequest *request ) ;
+int nanofs_async_poll  ( void ) ;                       /* Completadas recogidas / Completed reaped */
+int nanofs_async_wait  ( TypeFileRequest *request ) ;   /* NULL: cualquiera / any */
+int nanofs_async_fd    ( void ) ;                       /* eventfd legible si hay que llamar a poll */
+                                                        /* eventfd readable when poll has to be called */
+
 
 #endif
 
@@ -20,6 +20,10 @@
  */
 
 
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
 #include "nanofs.h"
 
 
@@ -158,12 +162,1395 @@ int debug_test_mount_open_read_close_unlink_umount ()
    return 0 ;
 }
 
+int debug_test_checksum ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str2[20] ;
+   char b[BLOCK_SIZE] ;
+   TypeMkfsOptions options ;
+   TypeStats st ;
+
+   printf("\n") ;
+   printf("Tests: mkfs(F_CHECKSUM) + creat + write + corrupt block + read\n") ;
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.features = F_CHECKSUM ;
+
+       printf(" * nanofs_mkfs_opts(32, F_CHECKSUM) -> ") ;
+       ret = nanofs_mkfs_opts(32, &options) ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mount() -> ") ;
+       ret = nanofs_mount() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       char *str1 = "hola mundo..." ;
+
+       printf(" * nanofs_creat('test2.txt') + nanofs_write(...) -> ") ;
+       ret = fd = nanofs_creat("test2.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, strlen(str1)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_umount() -> ") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: corromper en crudo el bloque que contiene los datos
+       // en: corrupt the raw block holding the data
+       printf(" * corrupt data block of 'test2.txt' -> ") ;
+       ret = -1 ;
+       for (int i=0; i<32; i++)
+       {
+            bread(DISK, i, b) ;
+            if (! memcmp(b, "hola", 4)) {
+                b[0] = 'H' ;
+                bwrite(DISK, i, b) ;
+                ret = i ;
+                break ;
+            }
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mount() -> ") ;
+       ret = nanofs_mount() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, 20) ;
+
+       printf(" * nanofs_open('test2.txt') + nanofs_read(...) -> ") ;
+       fd  = nanofs_open("test2.txt") ;
+       ret = nanofs_read(fd, str2, 13) ;
+       nanofs_close(fd) ;
+       printf("%d (expected -1)\n", ret) ;
+
+       nanofs_stats(&st) ;
+       printf(" * nanofs_stats() -> checksumErrors=%ld\n", (long)st.checksumErrors) ;
+
+       printf(" * nanofs_umount() -> ") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_compress ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str1[8*1024] ;
+   char str2[8*1024] ;
+   TypeMkfsOptions options ;
+   TypeStats st ;
+
+   printf("\n") ;
+   printf("Tests: mkfs(F_COMPRESS) + creat + write 8 KiB + close + open + read\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.features = F_COMPRESS ;
+
+       printf(" * nanofs_mkfs_opts(32, F_COMPRESS) -> ") ;
+       ret = nanofs_mkfs_opts(32, &options) ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mount() -> ") ;
+       ret = nanofs_mount() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_creat('test3.txt') + nanofs_write(...,%ld) + nanofs_close -> ", sizeof(str1)) ;
+       ret = fd = nanofs_creat("test3.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_open('test3.txt') + nanofs_read(...) -> ") ;
+       fd  = nanofs_open("test3.txt") ;
+       ret = nanofs_read(fd, str2, sizeof(str2)) ;
+       nanofs_close(fd) ;
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+
+       nanofs_stats(&st) ;
+       printf(" * nanofs_stats() -> clustersCompressed=%ld clustersRaw=%ld\n",
+              (long)st.clustersCompressed, (long)st.clustersRaw) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_unlink('test3.txt') + nanofs_umount() -> ") ;
+       nanofs_unlink("test3.txt") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_dedup ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str1[3*1024] ;
+   char str2[3*1024] ;
+   TypeMkfsOptions options ;
+   TypeStats st ;
+
+   printf("\n") ;
+   printf("Tests: mkfs(F_DEDUP) + two identical files + modify one + read the other\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = 'a' + (i % 26) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.features = F_DEDUP ;
+
+       printf(" * nanofs_mkfs_opts(32, F_DEDUP) + nanofs_mount() -> ") ;
+       ret = nanofs_mkfs_opts(32, &options) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   char *fnames[2] = { "test4a.txt", "test4b.txt" } ;
+   for (int f=0; (f<2) && (ret != -1); f++)
+   {
+       printf(" * nanofs_creat('%s') + nanofs_write(...,%ld) + nanofs_close -> ", fnames[f], sizeof(str1)) ;
+       ret = fd = nanofs_creat(fnames[f]) ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       nanofs_stats(&st) ;
+       printf(" * nanofs_stats() -> blocksDeduplicated=%ld\n", (long)st.blocksDeduplicated) ;
+
+       printf(" * nanofs_open('%s') + nanofs_write(...,'X',1) + nanofs_close -> ", fnames[1]) ;
+       fd  = nanofs_open(fnames[1]) ;
+       ret = nanofs_write(fd, "X", 1) ;
+       nanofs_close(fd) ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_open('%s') + nanofs_read(...) -> ", fnames[0]) ;
+       fd  = nanofs_open(fnames[0]) ;
+       ret = nanofs_read(fd, str2, sizeof(str2)) ;
+       nanofs_close(fd) ;
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_unlink(...) + nanofs_umount() -> ") ;
+       nanofs_unlink(fnames[0]) ;
+       nanofs_unlink(fnames[1]) ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_clone_snapshot ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str1[3*1024] ;
+   char str2[3*1024] ;
+   TypeMkfsOptions options ;
+   TypeStats st1, st2 ;
+
+   printf("\n") ;
+   printf("Tests: mkfs(2 snapshots) + clone + snapshot + modify + unlink + mount snapshot\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = 'a' + (i % 26) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.numSnapshots = 2 ;
+
+       printf(" * nanofs_mkfs_opts(32, 2 snapshots) + nanofs_mount() -> ") ;
+       ret = nanofs_mkfs_opts(32, &options) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_creat('test5.txt') + nanofs_write(...,%ld) + nanofs_close -> ", sizeof(str1)) ;
+       ret = fd = nanofs_creat("test5.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       nanofs_stats(&st1) ;
+       printf(" * nanofs_clone('test5.txt', 'test5c.txt') -> ") ;
+       ret = nanofs_clone("test5.txt", "test5c.txt") ;
+       nanofs_stats(&st2) ;
+       printf("%d (%ld blocks written)\n", ret, (long)(st2.blocksWritten - st1.blocksWritten)) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_snapshot_create() -> ") ;
+       ret = nanofs_snapshot_create() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_open('test5c.txt') + nanofs_write(...,'X',1) + nanofs_close -> ") ;
+       fd  = nanofs_open("test5c.txt") ;
+       ret = nanofs_write(fd, "X", 1) ;
+       nanofs_close(fd) ;
+       nanofs_stats(&st2) ;
+       printf("%d (blocksCopiedOnWrite=%ld)\n", ret, (long)st2.blocksCopiedOnWrite) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_open('test5.txt') + nanofs_read(...) -> ") ;
+       fd  = nanofs_open("test5.txt") ;
+       ret = nanofs_read(fd, str2, sizeof(str2)) ;
+       nanofs_close(fd) ;
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_unlink('test5.txt') + nanofs_umount() -> ") ;
+       nanofs_unlink("test5.txt") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount_snapshot(0) + nanofs_open('test5.txt') + nanofs_read(...) -> ") ;
+       ret = nanofs_mount_snapshot(0) ;
+       if (ret != -1) {
+           fd  = nanofs_open("test5.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+
+       printf(" * nanofs_unlink('test5c.txt') on snapshot -> %d (expected -1)\n", nanofs_unlink("test5c.txt")) ;
+       nanofs_umount() ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mount() + nanofs_snapshot_delete(0) + nanofs_unlink('test5c.txt') + nanofs_umount() -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           ret = nanofs_snapshot_delete(0) ;
+           nanofs_unlink("test5c.txt") ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_blocksize ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str1[10*1024] ;
+   char str2[10*1024] ;
+   TypeMkfsOptions options ;
+
+   printf("\n") ;
+   printf("Tests: mkfs(4 KiB blocks) + creat + write 10 KiB + close + umount + mount + read\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.blockSize = 3000 ;
+
+       printf(" * nanofs_mkfs_opts(8, 3000 bytes/block) -> ") ;
+       ret = nanofs_mkfs_opts(8, &options) ;
+       printf("%d (expected -1)\n", ret) ;
+   }
+
+   // es: 8 bloques de 4 KiB ocupan lo mismo que disk.dat (32 KiB)
+   // en: 8 blocks of 4 KiB take the same space as disk.dat (32 KiB)
+   options.blockSize = 4096 ;
+   printf(" * nanofs_mkfs_opts(8, 4096 bytes/block) + nanofs_mount() -> ") ;
+   ret = nanofs_mkfs_opts(8, &options) ;
+   if (ret != -1) {
+       ret = nanofs_mount() ;
+   }
+   printf("%d\n", ret) ;
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_creat('test6.txt') + nanofs_write(...,%ld) + nanofs_close + nanofs_umount -> ", sizeof(str1)) ;
+       ret = fd = nanofs_creat("test6.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount() + nanofs_open('test6.txt') + nanofs_read(...) -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("test6.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_unlink('test6.txt') + nanofs_umount() -> ") ;
+       nanofs_unlink("test6.txt") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_direct ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str1[5*1024] ;
+   char str2[5*1024] ;
+   TypeMkfsOptions options ;
+
+   printf("\n") ;
+   printf("Tests: setdev(direct:) + mkfs + creat + unaligned write + close + umount + mount + read\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.blockSize = 4096 ;
+
+       printf(" * nanofs_setdev('direct:%s') + nanofs_mkfs_opts(8, 4096 bytes/block) + nanofs_mount() -> ", DISK) ;
+       ret = nanofs_setdev("direct:" DISK) ;
+       if (ret != -1) {
+           ret = nanofs_mkfs_opts(8, &options) ;
+       }
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: buffer del usuario sin alinear (el backend usa uno de la reserva)
+       // en: unaligned user buffer (the backend uses one from the pool)
+       printf(" * nanofs_creat('test7.txt') + nanofs_write(...+1,%ld) + nanofs_close + nanofs_umount -> ", sizeof(str1)-1) ;
+       ret = fd = nanofs_creat("test7.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1+1, sizeof(str1)-1) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount() + nanofs_open('test7.txt') + nanofs_read(...) -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("test7.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1+1, str2, sizeof(str1)-1) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_unlink('test7.txt') + nanofs_umount() -> ") ;
+       nanofs_unlink("test7.txt") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   nanofs_setdev(DISK) ;
+
+   return 0 ;
+}
+
+
+int debug_test_async_done = 0 ;
+
+void debug_test_async_callback ( TypeBlockRequest *request )
+{
+   debug_test_async_done++ ;
+}
+
+int debug_test_async ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   char str1[16*1024] ;
+   char str2[16*1024] ;
+   char *b ;
+   TypeBlockRequest reqs[4] ;
+
+   printf("\n") ;
+   printf("Tests: baio_init + mkfs + creat + write + close + umount + mount + multi-block read + baio_submit/baio_wait\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   for (int engine=BAIO_ENGINE_AUTO; (engine<=BAIO_ENGINE_THREADS) && (ret != -1); engine+=BAIO_ENGINE_THREADS)
+   {
+       printf(" * baio_init(8, %s) -> ", (BAIO_ENGINE_AUTO == engine) ? "auto" : "threads") ;
+       ret = baio_init(8, engine) ;
+       printf("%d (%s)\n", (ret < 0) ? -1 : 1, (BAIO_ENGINE_THREADS == baio_engine()) ? "threads" : "io_uring") ;
+
+       if (ret != -1)
+       {
+           printf(" * nanofs_mkfs(32) + nanofs_mount() + nanofs_creat('test8.txt') + nanofs_write(...,%ld) + nanofs_close + nanofs_umount -> ", sizeof(str1)) ;
+           ret = nanofs_mkfs(32) ;
+           if (ret != -1) {
+               ret = nanofs_mount() ;
+           }
+           if (ret != -1) {
+               ret = fd = nanofs_creat("test8.txt") ;
+           }
+           if (ret != -1) {
+               ret = nanofs_write(fd, str1, sizeof(str1)) ;
+               nanofs_close(fd) ;
+               nanofs_umount() ;
+           }
+           printf("%d\n", ret) ;
+       }
+
+       if (ret != -1)
+       {
+           memset(str2, 0, sizeof(str2)) ;
+
+           // es: lectura de varios bloques (en curso a la vez)
+           // en: multi-block read (in flight at the same time)
+           printf(" * nanofs_mount() + nanofs_open('test8.txt') + nanofs_read(...) -> ") ;
+           ret = nanofs_mount() ;
+           if (ret != -1) {
+               fd  = nanofs_open("test8.txt") ;
+               ret = nanofs_read(fd, str2, sizeof(str2)) ;
+               nanofs_close(fd) ;
+               nanofs_umount() ;
+           }
+           printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+       }
+
+       if (ret != -1)
+       {
+           printf(" * baio_submit(4 reads) + baio_wait(...) -> ") ;
+           b = bpool_get(4 * BLOCK_SIZE) ;
+           debug_test_async_done = 0 ;
+           for (int i=0; (i<4) && (ret != -1); i++)
+           {
+                reqs[i].devname   = DISK ;
+                reqs[i].bid       = i ;
+                reqs[i].buffer    = b + i*BLOCK_SIZE ;
+                reqs[i].is_write  = 0 ;
+                reqs[i].callback  = debug_test_async_callback ;
+                reqs[i].user_data = NULL ;
+                ret = baio_submit(&(reqs[i])) ;
+           }
+           for (int i=0; (i<4) && (ret != -1); i++) {
+                ret = baio_wait(&(reqs[i])) ;
+           }
+           bpool_put(b) ;
+           bclose(DISK) ;
+           printf("%d (%d callbacks)\n", ret, debug_test_async_done) ;
+       }
+   }
+
+   baio_finalize() ;
+
+   return 0 ;
+}
+
+int debug_test_file_async_done = 0 ;
+
+void debug_test_file_async_callback ( TypeFileRequest *request )
+{
+   debug_test_file_async_done++ ;
+}
+
+int debug_test_file_async ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   int  n   = 0 ;
+   char str1[3*1024] ;
+   char str2[3*1024] ;
+   struct pollfd pfd ;
+   TypeFileRequest reqs[3] ;
+
+   printf("\n") ;
+   printf("Tests: mount + creat + write_async + read_async + eventfd + poll + close + unlink + umount\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mkfs(32) + nanofs_mount() + nanofs_creat('test9.txt') -> ") ;
+       ret = nanofs_mkfs(32) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       if (ret != -1) {
+           ret = fd = nanofs_creat("test9.txt") ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: tres escrituras en curso a la vez, en orden inverso de posición
+       // en: three writes in flight at the same time, in reverse position order
+       printf(" * nanofs_write_async(3 x 1024, callback) + nanofs_async_wait(...) -> ") ;
+       debug_test_file_async_done = 0 ;
+       for (int i=2; (i>=0) && (ret != -1); i--)
+       {
+            memset(&(reqs[i]), 0, sizeof(TypeFileRequest)) ;
+            reqs[i].fd       = fd ;
+            reqs[i].buffer   = str1 + i*1024 ;
+            reqs[i].size     = 1024 ;
+            reqs[i].offset   = i*1024 ;
+            reqs[i].callback = debug_test_file_async_callback ;
+            ret = nanofs_write_async(&(reqs[i])) ;
+       }
+       for (int i=0; (i<3) && (ret != -1); i++) {
+            ret = nanofs_async_wait(&(reqs[i])) ;
+       }
+       printf("%d (%d callbacks)\n", ret, debug_test_file_async_done) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       // es: lecturas sin callback: se espera al eventfd y se recogen con poll
+       // en: reads without callback: wait for the eventfd and reap them with poll
+       printf(" * nanofs_read_async(2 x 1536) + poll(nanofs_async_fd()) + nanofs_async_poll() -> ") ;
+       for (int i=0; (i<2) && (ret != -1); i++)
+       {
+            memset(&(reqs[i]), 0, sizeof(TypeFileRequest)) ;
+            reqs[i].fd     = fd ;
+            reqs[i].buffer = str2 + i*1536 ;
+            reqs[i].size   = 1536 ;
+            reqs[i].offset = -1 ;
+            ret = nanofs_read_async(&(reqs[i])) ;
+       }
+       pfd.fd     = nanofs_async_fd() ;
+       pfd.events = POLLIN ;
+       while ( (ret != -1) && (n < 2) )
+       {
+            ret = poll(&pfd, 1, 1000) ;
+            if (ret > 0) {
+                n += nanofs_async_poll() ;
+            }
+            else {
+                ret = -1 ;
+            }
+       }
+       if (ret != -1) {
+           ret = reqs[0].result + reqs[1].result ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       char str3[3][3*1024] ;
+       int  fds[3] ;
+       TypeFileRequest reqs6[6] ;
+
+       // es: una escritura y luego una lectura en cada uno de tres ficheros, todas en curso a la vez
+       // en: a write and then a read on each of three files, all of them in flight at the same time
+       printf(" * nanofs_write_async + nanofs_read_async(3 files x 3000 at 100) + nanofs_async_wait(NULL) -> ") ;
+       fds[0] = fd ;
+       fds[1] = nanofs_creat("test9a.txt") ;
+       fds[2] = nanofs_creat("test9b.txt") ;
+       memset(str3, 0, sizeof(str3)) ;
+       n = 0 ;
+       for (int i=0; (i<6) && (ret != -1); i++)
+       {
+            memset(&(reqs6[i]), 0, sizeof(TypeFileRequest)) ;
+            reqs6[i].fd     = fds[i % 3] ;
+            reqs6[i].buffer = (i < 3) ? str1 : str3[i % 3] ;
+            reqs6[i].size   = 3000 ;
+            reqs6[i].offset = 100 ;
+            ret = (i < 3) ? nanofs_write_async(&(reqs6[i])) : nanofs_read_async(&(reqs6[i])) ;
+       }
+       while ( (ret != -1) && (n < 6) )
+       {
+            ret = nanofs_async_wait(NULL) ;
+            n += ret ;
+       }
+       for (int i=0; (i<3) && (ret != -1); i++) {
+            ret = (memcmp(str1, str3[i], 3000)) ? -1 : reqs6[3+i].result ;
+       }
+       printf("%d (%s)\n", ret, (ret != -1) ? "same data" : "differs") ;
+       nanofs_close(fds[1]) ;
+       nanofs_close(fds[2]) ;
+       nanofs_unlink("test9a.txt") ;
+       nanofs_unlink("test9b.txt") ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_close + nanofs_unlink('test9.txt') + nanofs_umount() -> ") ;
+       nanofs_close(fd) ;
+       nanofs_unlink("test9.txt") ;
+       ret = nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_batch ()
+{
+   int  ret = 1 ;
+   int  fd  = 1 ;
+   TypeBatchOp ops[8] = {
+       { OP_CREAT,  "a.txt" }, { OP_CREAT,  "b.txt" }, { OP_CREAT, "a.txt" }, { OP_STAT, "a.txt" },
+       { OP_UNLINK, "b.txt" }, { OP_CREAT,  "c.txt" }, { OP_STAT,  "b.txt" }, { OP_STAT, "c.txt" }
+   } ;
+
+   printf("\n") ;
+   printf("Tests: mount + batch(creat, unlink, stat) + open + close + umount\n") ;
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mkfs(32) + nanofs_mount() -> ") ;
+       ret = nanofs_mkfs(32) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: 'a.txt' ya existe en el tercero y 'b.txt' ya no en el séptimo
+       // en: 'a.txt' already exists in the third one and 'b.txt' no longer in the seventh
+       printf(" * nanofs_batch(8 ops) -> ") ;
+       ret = nanofs_batch(ops, 8) ;
+       printf("%d (", ret) ;
+       for (int i=0; i<8; i++) {
+            printf("%s%d", (i > 0) ? "," : "", ops[i].result) ;
+       }
+       printf(")\n") ;
+       ret = (6 == ret) ? 1 : -1 ;
+   }
+
+   if (ret != -1)
+   {
+       // es: un fichero abierto no se borra (como en nanofs_unlink)
+       // en: an open file is not removed (as in nanofs_unlink)
+       TypeBatchOp unlink_op = { OP_UNLINK, "c.txt" } ;
+       int unlinked = 0 ;
+
+       printf(" * nanofs_open('c.txt') + nanofs_batch(unlink 'c.txt') + nanofs_close + nanofs_umount() -> ") ;
+       ret = fd = nanofs_open("c.txt") ;
+       if (ret != -1) {
+           unlinked = nanofs_batch(&unlink_op, 1) ;
+           nanofs_close(fd) ;
+           ret = nanofs_umount() ;
+       }
+       printf("%d (unlinked=%d)\n", ret, unlinked) ;
+   }
+
+   return 0 ;
+}
+
+int debug_test_blockd ()
+{
+   int   ret = 1 ;
+   int   fd  = 1 ;
+   pid_t pid ;
+   char  str1[5*1024] ;
+   char  str2[5*1024] ;
+   char *b1, *b2 ;
+
+   printf("\n") ;
+   printf("Tests: blockd + setdev(unix:) + mkfs + mount + creat + write + close + umount + mount + read + breadn\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   // es: arrancar el servidor de bloques sobre el disco y esperar a que acepte conexiones
+   // en: start the block server on the disk and wait until it accepts connections
+   printf(" * ./blockd %s unix:nanofs.sock -> ", DISK) ;
+   b1 = bpool_get(8*BLOCK_SIZE) ;
+   b2 = bpool_get(8*BLOCK_SIZE) ;
+   fflush(stdout) ;
+   pid = fork() ;
+   if (0 == pid) {
+       freopen("/dev/null", "w", stdout) ;
+       execl("./blockd", "blockd", DISK, "unix:nanofs.sock", NULL) ;
+       exit(-1) ;
+   }
+   ret = -1 ;
+   for (int i=0; (i<200) && (ret < 0) && (pid > 0); i++)
+   {
+        ret = breadn("unix:nanofs.sock", 0, 1, b1) ;
+        if (ret < 0) {
+            usleep(10*1000) ;
+        }
+   }
+   printf("%d\n", ret) ;
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_setdev('unix:nanofs.sock') + nanofs_mkfs(32) + nanofs_mount() -> ") ;
+       ret = nanofs_setdev("unix:nanofs.sock") ;
+       if (ret != -1) {
+           ret = nanofs_mkfs(32) ;
+       }
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_creat('test10.txt') + nanofs_write(...,%ld) + nanofs_close + nanofs_umount -> ", sizeof(str1)) ;
+       ret = fd = nanofs_creat("test10.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount() + nanofs_open('test10.txt') + nanofs_read(...) + nanofs_close + nanofs_umount -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("test10.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       // es: una sola petición de 8 bloques por la red frente al disco local
+       // en: a single 8-block request over the network against the local disk
+       printf(" * breadn('unix:nanofs.sock', 0, 8) + breadn('%s', 0, 8) -> ", DISK) ;
+       ret = breadn("unix:nanofs.sock", 0, 8, b1) ;
+       if (ret != -1) {
+           ret = breadn(DISK, 0, 8, b2) ;
+       }
+       printf("%d (%s)\n", ret, memcmp(b1, b2, 8*BLOCK_SIZE) ? "differs" : "same data") ;
+   }
+
+   bclose("unix:nanofs.sock") ;
+   bclose(DISK) ;
+   bpool_put(b1) ;
+   bpool_put(b2) ;
+   if (pid > 0) {
+       kill(pid, SIGTERM) ;
+       waitpid(pid, NULL, 0) ;
+   }
+   unlink("nanofs.sock") ;
+   nanofs_setdev(DISK) ;
+
+   return 0 ;
+}
+
+int debug_test_stripe ()
+{
+   int   ret = 1 ;
+   int   fd  = 1 ;
+   FILE *f ;
+   char *b1, *b2 ;
+   static char str1[200*1024] ;
+   static char str2[200*1024] ;
+
+   printf("\n") ;
+   printf("Tests: setdev(stripe:) + mkfs + mount + creat + write + close + umount + mount + read + breadn\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   // es: segundo miembro vacío (el primero es el disco de siempre)
+   // en: empty second member (the first one is the usual disk)
+   b1 = bpool_get(8*BLOCK_SIZE) ;
+   b2 = bpool_get(8*BLOCK_SIZE) ;
+   f  = fopen("disk2.dat", "w") ;
+   if (NULL != f) {
+       fclose(f) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_setdev('stripe:64+64:%s,disk2.dat') + nanofs_mkfs(512) + nanofs_mount() -> ", DISK) ;
+       ret = nanofs_setdev("stripe:64+64:" DISK ",disk2.dat") ;
+       if (ret != -1) {
+           ret = nanofs_mkfs(512) ;
+       }
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: más grande que una unidad, así que se reparte entre los dos miembros
+       // en: larger than one unit, so it is spread over both members
+       printf(" * nanofs_creat('test11.txt') + nanofs_write(...,%ld) + nanofs_close + nanofs_umount -> ", sizeof(str1)) ;
+       ret = fd = nanofs_creat("test11.txt") ;
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mount() + nanofs_open('test11.txt') + nanofs_read(...) + nanofs_close + nanofs_umount -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("test11.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       // es: cabecera (64 KiB) y primera unidad en el primer miembro, la segunda unidad es el principio del segundo
+       // en: head (64 KiB) and first unit in the first member, the second unit is the beginning of the second one
+       printf(" * breadn('stripe:...', 128K/%d, 8) + breadn('disk2.dat', 0, 8) -> ", BLOCK_SIZE) ;
+       ret = breadn("stripe:64+64:" DISK ",disk2.dat", 128*1024/BLOCK_SIZE, 8, b1) ;
+       if (ret != -1) {
+           ret = breadn("disk2.dat", 0, 8, b2) ;
+       }
+       printf("%d (%s)\n", ret, memcmp(b1, b2, 8*BLOCK_SIZE) ? "differs" : "same data") ;
+   }
+
+   bclose("stripe:64+64:" DISK ",disk2.dat") ;
+   bclose("disk2.dat") ;
+   bpool_put(b1) ;
+   bpool_put(b2) ;
+   unlink("disk2.dat") ;
+   nanofs_setdev(DISK) ;
+
+   return 0 ;
+}
+
+
+int debug_test_fsck ()
+{
+   int   ret = 1 ;
+   int   fd  = 1 ;
+   char  str1[5*1024] ;
+   char  str2[5*1024] ;
+   char *b ;
+   int   indirect ;
+   TypeSuperblock sb ;
+   TypeFsckReport report ;
+   TypeRefMap    *r ;
+   TypeMkfsOptions options ;
+
+   printf("\n") ;
+   printf("Tests: mkfs + creat + write + umount + fsck + (leak + double allocation) + fsck repair + fsck + mount + read\n") ;
+   printf("       + clone + (shared bad pointer + damaged checksum area) + fsck + fsck repair + fsck + mount + read\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mkfs(64) + nanofs_mount() + nanofs_creat('test12.txt') + nanofs_write(...,%ld) + nanofs_close + nanofs_umount -> ", sizeof(str1)) ;
+       ret = nanofs_mkfs(64) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       if (ret != -1) {
+           ret = fd = nanofs_creat("test12.txt") ;
+       }
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       ret = nanofs_fsck(0, 4, &report) ;
+       printf(" * nanofs_fsck(check, 4 threads) -> %d (inodes=%u blocks=%u)\n", ret, report.inodesUsed, report.blocksUsed) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: romper los mapas a mano: el último bloque perdido y el primero (del fichero) libre
+       // en: break the maps by hand: the last block leaked and the first one (of the file) free
+       printf(" * bread(0) + breadn(maps) + leak + double allocation + bwriten(maps) -> ") ;
+       b   = bpool_get(BLOCK_SIZE_MAX) ;
+       ret = bread(DISK, 0, b) ;
+       memmove(&sb, b, sizeof(TypeSuperblock)) ;
+       bpool_put(b) ;
+       b = bpool_get(sb.numMapsBlocks * sb.blockSize) ;
+       if (ret != -1) {
+           ret = breadn(DISK, sb.firstMapsBlock, sb.numMapsBlocks, b) ;
+       }
+       if (ret != -1)
+       {
+           r = (TypeRefMap *)(b + sizeof(TypeInodeMap) + sb.numDataBlocks * (sizeof(TypeBlockMap) + sizeof(TypeClusterMap))) ;
+           b[sizeof(TypeInodeMap) + sb.numDataBlocks - 1] = 1 ;
+           r[sb.numDataBlocks - 1] = 1 ;
+           b[sizeof(TypeInodeMap)] = 0 ;
+           r[0] = 0 ;
+           ret = bwriten(DISK, sb.firstMapsBlock, sb.numMapsBlocks, b) ;
+       }
+       bpool_put(b) ;
+       bclose(DISK) ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       ret = nanofs_fsck(1, 4, &report) ;
+       printf(" * nanofs_fsck(repair, 4 threads) -> %d (leaked=%u double=%u repaired=%u)\n", ret, report.leakedBlocks, report.doubleBlocks, report.repaired) ;
+   }
+
+   if (ret != -1)
+   {
+       ret = nanofs_fsck(0, 1, &report) ;
+       printf(" * nanofs_fsck(check, 1 thread) -> %d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount() + nanofs_open('test12.txt') + nanofs_read(...) + nanofs_close + nanofs_umount -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("test12.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.features = F_CHECKSUM ;
+
+       printf(" * nanofs_mkfs_opts(64, F_CHECKSUM) + nanofs_mount() + nanofs_creat('test12.txt') + nanofs_write(...) + nanofs_clone('test12.txt', 'test12c.txt') + nanofs_umount -> ") ;
+       ret = nanofs_mkfs_opts(64, &options) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       if (ret != -1) {
+           ret = fd = nanofs_creat("test12.txt") ;
+       }
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+       }
+       if (ret != -1) {
+           ret = nanofs_clone("test12.txt", "test12c.txt") ;
+       }
+       if (ret != -1) {
+           ret = nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: un puntero fuera de rango en el bloque indirecto compartido y el área de sumas dañada
+       // en: an out of range pointer in the shared indirect block and a damaged checksum area
+       printf(" * bread(0) + bad pointer in the shared indirect block + corrupt checksum area -> ") ;
+       b   = bpool_get(BLOCK_SIZE_MAX) ;
+       ret = bread(DISK, 0, b) ;
+       memmove(&sb, b, sizeof(TypeSuperblock)) ;
+       if (ret != -1) {
+           ret = bread(DISK, sb.firstInodeBlock, b) ;
+       }
+       if (ret != -1) {
+           ret = indirect = ((TypeInodeDisk *)b)[0].indirectBlock ;
+       }
+       if (ret != -1) {
+           ret = bread(DISK, sb.firstDataBlock + indirect, b) ;
+       }
+       if (ret != -1) {
+           ((int32_t *)b)[10] = sb.numDataBlocks + 100 ;
+           ret = bwrite(DISK, sb.firstDataBlock + indirect, b) ;
+       }
+       if (ret != -1) {
+           ret = bread(DISK, sb.firstCrcBlock, b) ;
+       }
+       if (ret != -1) {
+           b[0] ^= 0xFF ;
+           ret = bwrite(DISK, sb.firstCrcBlock, b) ;
+       }
+       bpool_put(b) ;
+       bclose(DISK) ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       ret = nanofs_fsck(0, 4, &report) ;
+       printf(" * nanofs_fsck(check, 4 threads) -> %d (pointers=%u checksums=%u)\n", ret, report.badPointers, report.checksumErrors) ;
+   }
+
+   if (ret != -1)
+   {
+       ret = nanofs_fsck(1, 4, &report) ;
+       printf(" * nanofs_fsck(repair, 4 threads) -> %d (pointers=%u checksums=%u repaired=%u)\n", ret, report.badPointers, report.checksumErrors, report.repaired) ;
+   }
+
+   if (ret != -1)
+   {
+       ret = nanofs_fsck(0, 4, &report) ;
+       printf(" * nanofs_fsck(check, 4 threads) -> %d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount() + nanofs_open('test12c.txt') + nanofs_read(...) + nanofs_close + nanofs_umount -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("test12c.txt") ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d (%s)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data") ;
+   }
+
+   return 0 ;
+}
+
+
+int debug_test_groups ()
+{
+   int   ret = 1 ;
+   int   fd1 = 1 ;
+   int   fd2 = 1 ;
+   int   runs ;
+   char  last ;
+   char  str1[BLOCK_SIZE] ;
+   char  str2[BLOCK_SIZE] ;
+   char *b ;
+   TypeSuperblock  sb ;
+   TypeMkfsOptions options ;
+
+   printf("\n") ;
+   printf("Tests: mkfs(groupBlocks) + creat x 2 + interleaved writes + umount + count runs on disk + mount + read\n") ;
+
+   if (ret != -1)
+   {
+       memset(&options, 0, sizeof(TypeMkfsOptions)) ;
+       options.groupBlocks = 64 ;
+
+       printf(" * nanofs_mkfs_opts(512, groupBlocks=64) + nanofs_mount() -> ") ;
+       ret = nanofs_mkfs_opts(512, &options) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: dos ficheros que crecen a la vez, un bloque cada vez
+       // en: two files growing at the same time, one block at a time
+       printf(" * nanofs_creat('test13.txt', 'test14.txt') + 16 x (nanofs_write(fd1,'A'...) + nanofs_write(fd2,'B'...)) -> ") ;
+       memset(str1, 'A', sizeof(str1)) ;
+       memset(str2, 'B', sizeof(str2)) ;
+       ret = fd1 = nanofs_creat("test13.txt") ;
+       if (ret != -1) {
+           ret = fd2 = nanofs_creat("test14.txt") ;
+       }
+       for (int i=0; (i<16) && (ret != -1); i++) {
+           ret = nanofs_write(fd1, str1, sizeof(str1)) ;
+           if (ret != -1) {
+               ret = nanofs_write(fd2, str2, sizeof(str2)) ;
+           }
+       }
+       nanofs_close(fd1) ;
+       nanofs_close(fd2) ;
+       nanofs_umount() ;
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: contar tramos 'A'/'B' en el área de datos: 2 si cada fichero quedó contiguo
+       // en: count 'A'/'B' runs in the data area: 2 if each file stayed contiguous
+       b   = bpool_get(BLOCK_SIZE_MAX) ;
+       ret = bread(DISK, 0, b) ;
+       memmove(&sb, b, sizeof(TypeSuperblock)) ;
+       runs = 0 ;
+       last = 0 ;
+       for (int i=0; (i<(int)sb.numDataBlocks) && (ret != -1); i++)
+       {
+           ret = bread(DISK, sb.firstDataBlock + i, b) ;
+           if ( (b[0] == 'A' || b[0] == 'B') && (b[0] == b[sb.blockSize-1]) && (b[0] != last) ) {
+               runs++ ;
+               last = b[0] ;
+           }
+       }
+       bpool_put(b) ;
+       bclose(DISK) ;
+       printf(" * bread(superblock) + bread(data blocks) -> %d (numGroups=%u runs=%d)\n", ret, sb.numGroups, runs) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str1, 0, sizeof(str1)) ;
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_mount() + nanofs_open('test13.txt', 'test14.txt') + nanofs_read(...) + nanofs_umount -> ") ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd1 = nanofs_open("test13.txt") ;
+           fd2 = nanofs_open("test14.txt") ;
+           for (int i=0; (i<16) && (ret != -1); i++) {
+               ret = nanofs_read(fd1, str1, sizeof(str1)) ;
+               if ( (ret != -1) && (str1[0] != 'A' || str1[sizeof(str1)-1] != 'A') ) {
+                   ret = -1 ;
+               }
+               if (ret != -1) {
+                   ret = nanofs_read(fd2, str2, sizeof(str2)) ;
+               }
+               if ( (ret != -1) && (str2[0] != 'B' || str2[sizeof(str2)-1] != 'B') ) {
+                   ret = -1 ;
+               }
+           }
+           nanofs_close(fd1) ;
+           nanofs_close(fd2) ;
+           nanofs_umount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   return 0 ;
+}
+
+
+int debug_test_bulk ()
+{
+   int   ret = 1 ;
+   int   fd  = 1 ;
+   int   position = 0 ;
+   int   n = 0 ;
+   static char str1[200*1024] ;
+   static char str2[200*1024] ;
+   char  name[NAME_LENGTH+1] ;
+   TypeStats st1, st2 ;
+
+   printf("\n") ;
+   printf("Tests: mkfs + creat('dir/name') + bulk write + block I/O count + readdir + read\n") ;
+
+   for (int i=0; i<(int)sizeof(str1); i++) {
+        str1[i] = "hola mundo..."[i % 13] ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_mkfs(256) + nanofs_mount() -> ") ;
+       ret = nanofs_mkfs(256) ;
+       if (ret != -1) {
+           ret = nanofs_mount() ;
+       }
+       printf("%d\n", ret) ;
+   }
+
+   if (ret != -1)
+   {
+       // es: 200 bloques completos tras el final del fichero en una sola llamada
+       // en: 200 full blocks past the end of file in a single call
+       printf(" * nanofs_creat('dir/test15.txt') + nanofs_write(...,0) + nanofs_write(...,%ld) + nanofs_close -> ", sizeof(str1)) ;
+       nanofs_stats(&st1) ;
+       ret = fd = nanofs_creat("dir/test15.txt") ;
+       if ( (ret != -1) && (nanofs_write(fd, str1, 0) != 0) ) {
+           ret = -1 ;
+       }
+       if (ret != -1) {
+           ret = nanofs_write(fd, str1, sizeof(str1)) ;
+           nanofs_close(fd) ;
+       }
+       nanofs_stats(&st2) ;
+       printf("%d (%ld blocks written, %ld blocks read)\n", ret,
+              (long)(st2.blocksWritten - st1.blocksWritten), (long)(st2.blocksRead - st1.blocksRead)) ;
+   }
+
+   if (ret != -1)
+   {
+       printf(" * nanofs_readdir(...) -> ") ;
+       while (nanofs_readdir(&position, name) > 0) {
+           printf("%s ", name) ;
+           n++ ;
+       }
+       printf("(%d)\n", n) ;
+   }
+
+   if (ret != -1)
+   {
+       memset(str2, 0, sizeof(str2)) ;
+
+       printf(" * nanofs_umount() + nanofs_mount() + nanofs_open('dir/test15.txt') + nanofs_read(...) + nanofs_close + nanofs_umount -> ") ;
+       nanofs_umount() ;
+       ret = nanofs_mount() ;
+       if (ret != -1) {
+           fd  = nanofs_open("dir/test15.txt") ;
+           nanofs_stats(&st1) ;
+           ret = nanofs_read(fd, str2, sizeof(str2)) ;
+           nanofs_stats(&st2) ;
+           nanofs_close(fd) ;
+           nanofs_umount() ;
+       }
+       printf("%d (%s, %ld blocks read)\n", ret, memcmp(str1, str2, sizeof(str1)) ? "differs" : "same data",
+              (long)(st2.blocksRead - st1.blocksRead)) ;
+   }
+
+   return 0 ;
+}
+
 
 int main()
 {
    debug_test_mkfs_mount_umount() ;
    debug_test_mount_creat_write_close_umount() ;
    debug_test_mount_open_read_close_unlink_umount() ;
+   debug_test_checksum() ;
+   debug_test_compress() ;
+   debug_test_dedup() ;
+   debug_test_clone_snapshot() ;
+   debug_test_blocksize() ;
+   debug_test_direct() ;
+   debug_test_async() ;
+   debug_test_file_async() ;
+   debug_test_batch() ;
+   debug_test_blockd() ;
+   debug_test_stripe() ;
+   debug_test_fsck() ;
+   debug_test_groups() ;
+   debug_test_bulk() ;
 
    return 0 ;
 }